@@ -3,16 +3,22 @@
 namespace eosio {
 void brandedtoken::create( account_name issuer,symbol_type symbolo )
 {
+    PROFILE_SECTION( "create" );
     require_auth(_self);
 
     eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+#ifdef BRANDEDTOKEN_SINGLE_SYMBOL
+    eosio_assert( symbolo == symbol_type(brand_symbol), "contract is built for a single symbol" );
+#endif
 
     stats statstable( _self, symbolo.name() );
+    PROFILE_READS( 1 );
     auto existing = statstable.find( symbolo.name() );
     eosio_assert( existing == statstable.end(), "token with symbol already exists" );
 
     asset newquantity = asset{1,symbolo};
 
+    PROFILE_WRITES( 1 );
     statstable.emplace( _self, [&]( auto& s ) {
        s.supply.symbol = symbolo;
        s.max_supply    = newquantity;
@@ -23,12 +29,14 @@ void brandedtoken::create( account_name issuer,symbol_type symbolo )
 
 void brandedtoken::issue( account_name to, asset quantity, string memo )
 {
+    PROFILE_SECTION( "issue" );
     auto sym = quantity.symbol;
     eosio_assert( sym.is_valid(), "invalid symbol name" );
     eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
 
     auto sym_name = sym.name();
     stats statstable( _self, sym_name );
+    PROFILE_READS( 1 );
     auto existing = statstable.find( sym_name );
     eosio_assert( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
     const auto& st = *existing;
@@ -40,6 +48,7 @@ void brandedtoken::issue( account_name to, asset quantity, string memo )
     eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
     eosio_assert( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
 
+    PROFILE_WRITES( 1 );
     statstable.modify( st, 0, [&]( auto& s ) {
        s.supply += quantity;
     });
@@ -47,18 +56,71 @@ void brandedtoken::issue( account_name to, asset quantity, string memo )
     add_balance( st.issuer, quantity, st.issuer );
 
     if( to != st.issuer ) {
+       PROFILE_SENDS( 1 );
        SEND_INLINE_ACTION( *this, transfer, {st.issuer,N(active)}, {st.issuer, to, quantity, memo} );
     }
 }
 
+void brandedtoken::mint( symbol_type symbolo, vector<mintentry> accounts, vector<mintentry> lgids, string memo )
+{
+    PROFILE_SECTION( "mint" );
+    eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+    eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
+
+    auto sym_name = symbolo.name();
+    stats statstable( _self, sym_name );
+    PROFILE_READS( 1 );
+    auto existing = statstable.find( sym_name );
+    eosio_assert( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
+    const auto& st = *existing;
+
+    require_auth( st.issuer );
+    eosio_assert( symbolo == st.supply.symbol, "symbol precision mismatch" );
+
+    //Credit every recipient directly, checking the running total against max supply
+    int64_t available = st.max_supply.amount - st.supply.amount;
+    int64_t total = 0;
+    for( const auto& e : accounts ) {
+       eosio_assert( is_account( e.to ), "to account does not exist" );
+       eosio_assert( e.amount > 0, "must issue positive quantity" );
+       eosio_assert( e.amount <= available - total, "quantity exceeds available supply" );
+       total += e.amount;
+       add_balance( e.to, asset{e.amount, symbolo}, st.issuer );
+       require_recipient( e.to );
+       PROFILE_NOTIFIES( 1 );
+    }
+
+    //Ledger balances are backed by custody on each ledger's stripe, one write per stripe
+    int64_t stripe_totals[custody_stripes] = {};
+    for( const auto& e : lgids ) {
+       eosio_assert( e.amount > 0, "must issue positive quantity" );
+       eosio_assert( e.amount <= available - total, "quantity exceeds available supply" );
+       total += e.amount;
+       stripe_totals[custody_stripe_of( e.to )] += e.amount;
+       add_ledger( e.to, asset{e.amount, symbolo}, st.issuer );
+    }
+    eosio_assert( total > 0, "nothing to mint" );
+
+    for( uint64_t stripe = 0; stripe < custody_stripes; ++stripe ) {
+       if( stripe_totals[stripe] > 0 ) add_custody_stripe( _self, symbolo, stripe, stripe_totals[stripe] );
+    }
+
+    PROFILE_WRITES( 1 );
+    statstable.modify( st, 0, [&]( auto& s ) {
+       s.supply.amount += total;
+    });
+}
+
 void brandedtoken::retire( asset quantity, string memo )
 {
+    PROFILE_SECTION( "retire" );
     auto sym = quantity.symbol;
     eosio_assert( sym.is_valid(), "invalid symbol name" );
     eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
 
     auto sym_name = sym.name();
     stats statstable( _self, sym_name );
+    PROFILE_READS( 1 );
     auto existing = statstable.find( sym_name );
     eosio_assert( existing != statstable.end(), "token with symbol does not exist" );
     const auto& st = *existing;
@@ -69,6 +131,7 @@ void brandedtoken::retire( asset quantity, string memo )
 
     eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
 
+    PROFILE_WRITES( 1 );
     statstable.modify( st, 0, [&]( auto& s ) {
        s.supply -= quantity;
     });
@@ -81,19 +144,26 @@ void brandedtoken::transfer( account_name from,
                       asset        quantity,
                       string       memo )
 {
+    PROFILE_SECTION( "transfer" );
+    move_balance( from, to, quantity, memo );
+    record_activity( _self, quantity.symbol.name(), activity_transfer, quantity.amount, from );
+}
+
+//transfer body shared with the ledger deposit/withdraw paths, which record their own activity
+void brandedtoken::move_balance( account_name from, account_name to, asset quantity, string memo )
+{
+    PROFILE_SECTION( "move_balance" );
     eosio_assert( from != to, "cannot transfer to self" );
     require_auth( from );
     eosio_assert( is_account( to ), "to account does not exist");
-    auto sym = quantity.symbol.name();
-    stats statstable( _self, sym );
-    const auto& st = statstable.get( sym );
+    check_symbol( quantity );
 
     require_recipient( from );
     require_recipient( to );
+    PROFILE_NOTIFIES( 2 );
 
     eosio_assert( quantity.is_valid(), "invalid quantity" );
     eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
-    eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
     eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
 
     auto payer = has_auth( to ) ? to : from;
@@ -102,12 +172,58 @@ void brandedtoken::transfer( account_name from,
     add_balance( to, quantity, payer );
 }
 
+void brandedtoken::check_symbol( const asset& quantity )const
+{
+#ifdef BRANDEDTOKEN_SINGLE_SYMBOL
+    //create only accepts brand_symbol in this build, so no other stat row can exist
+    eosio_assert( quantity.symbol == symbol_type(brand_symbol), "symbol precision mismatch" );
+#else
+    auto sym = quantity.symbol.name();
+    stats statstable( _self, sym );
+    PROFILE_READS( 1 );
+    const auto& st = statstable.get( sym );
+    eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+#endif
+}
+
+//Move tokens from an EOS account into ledger custody, without touching this contract's own balance row
+void brandedtoken::deposit_custody( account_name from, uint64_t lgid, asset quantity )
+{
+    PROFILE_SECTION( "deposit_custody" );
+    eosio_assert( quantity.is_valid(), "invalid quantity" );
+    eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
+    check_symbol( quantity );
+    require_recipient( from );
+    PROFILE_NOTIFIES( 1 );
+
+    sub_balance( from, quantity );
+    add_custody( _self, quantity.symbol, lgid, quantity.amount );
+}
+
+//Pay tokens out of ledger custody to an EOS account
+void brandedtoken::withdraw_custody( uint64_t lgid, account_name to, asset quantity )
+{
+    PROFILE_SECTION( "withdraw_custody" );
+    eosio_assert( to != _self, "cannot withdraw to self" );
+    eosio_assert( is_account( to ), "to account does not exist");
+    eosio_assert( quantity.is_valid(), "invalid quantity" );
+    eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
+    require_recipient( to );
+    PROFILE_NOTIFIES( 1 );
+
+    add_custody( _self, quantity.symbol, lgid, -quantity.amount );
+    add_balance( to, quantity, _self );
+}
+
 void brandedtoken::sub_balance( account_name owner, asset value ) {
+   PROFILE_SECTION( "sub_balance" );
    accounts from_acnts( _self, owner );
 
+   PROFILE_READS( 1 );
    const auto& from = from_acnts.get( value.symbol.name(), "no balance object found" );
    eosio_assert( from.balance.amount >= value.amount, "overdrawn balance" );
 
+   PROFILE_WRITES( 1 );
    from_acnts.modify( from, owner, [&]( auto& a ) {
          a.balance -= value;
       });
@@ -115,13 +231,17 @@ void brandedtoken::sub_balance( account_name owner, asset value ) {
 
 void brandedtoken::add_balance( account_name owner, asset value, account_name ram_payer )
 {
+   PROFILE_SECTION( "add_balance" );
    accounts to_acnts( _self, owner );
+   PROFILE_READS( 1 );
    auto to = to_acnts.find( value.symbol.name() );
    if( to == to_acnts.end() ) {
+      PROFILE_WRITES( 1 );
       to_acnts.emplace( ram_payer, [&]( auto& a ){
         a.balance = value;
       });
    } else {
+      PROFILE_WRITES( 1 );
       to_acnts.modify( to, 0, [&]( auto& a ) {
         a.balance += value;
       });
@@ -130,10 +250,13 @@ void brandedtoken::add_balance( account_name owner, asset value, account_name ra
 
 void brandedtoken::open( account_name owner, symbol_type symbol, account_name ram_payer )
 {
+   PROFILE_SECTION( "open" );
    require_auth( ram_payer );
    accounts acnts( _self, owner );
+   PROFILE_READS( 1 );
    auto it = acnts.find( symbol.name() );
    if( it == acnts.end() ) {
+      PROFILE_WRITES( 1 );
       acnts.emplace( ram_payer, [&]( auto& a ){
         a.balance = asset{0, symbol};
       });
@@ -142,17 +265,58 @@ void brandedtoken::open( account_name owner, symbol_type symbol, account_name ra
 
 void brandedtoken::close( account_name owner, symbol_type symbol )
 {
+   PROFILE_SECTION( "close" );
    require_auth( owner );
    accounts acnts( _self, owner );
+   PROFILE_READS( 1 );
    auto it = acnts.find( symbol.name() );
    eosio_assert( it != acnts.end(), "Balance row already deleted or never existed. Action won't have any effect." );
    eosio_assert( it->balance.amount == 0, "Cannot close because the balance is not zero." );
-   acnts.erase( it );
+   PROFILE_WRITES( 1 );
+   acnts.erase( *it );
+}
+
+void brandedtoken::setbrand(symbol_type symbolo, account_name supplyauth){
+    PROFILE_SECTION( "setbrand" );
+    require_auth( _self );
+
+    eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+    eosio_assert( is_account( supplyauth ), "supply authority account does not exist" );
+
+    stats statstable( _self, symbolo.name() );
+    PROFILE_READS( 1 );
+    const auto& st = statstable.get( symbolo.name(), "token with symbol does not exist" );
+    eosio_assert( symbolo == st.supply.symbol, "symbol precision mismatch" );
+
+    brands brandtbl( _self, symbolo.name() );
+    PROFILE_READS( 1 );
+    auto existing = brandtbl.find( symbolo.name() );
+    if( existing == brandtbl.end() ) {
+       PROFILE_WRITES( 1 );
+       brandtbl.emplace( _self, [&]( auto& b ) {
+          b.symbol      = symbolo;
+          b.supply_auth = supplyauth;
+       });
+    } else {
+       PROFILE_WRITES( 1 );
+       brandtbl.modify( existing, 0, [&]( auto& b ) {
+          b.supply_auth = supplyauth;
+       });
+    }
+}
+
+void brandedtoken::require_supply_auth( symbol_name sym )const
+{
+    brands brandtbl( _self, sym );
+    PROFILE_READS( 1 );
+    const auto& b = brandtbl.get( sym, "brand is not registered" );
+    require_auth( b.supply_auth );
 }
 
 // increase max supply
 void brandedtoken::addsupply(asset quantity, string memo){
-    require_auth(N(tapatalktpx1));
+    PROFILE_SECTION( "addsupply" );
+    require_supply_auth( quantity.symbol.name() );
 
     auto sym = quantity.symbol;
 
@@ -161,6 +325,7 @@ void brandedtoken::addsupply(asset quantity, string memo){
 
     auto sym_name = sym.name();
     stats statstable( _self, sym_name );
+    PROFILE_READS( 1 );
     auto existing = statstable.find( sym_name );
     eosio_assert( existing != statstable.end(), "token with symbol does not exist" );
     const auto& st = *existing;
@@ -169,15 +334,18 @@ void brandedtoken::addsupply(asset quantity, string memo){
     eosio_assert( quantity.amount > 0, "must add positive quantity" );
     eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
     
+    PROFILE_WRITES( 1 );
     statstable.modify( st, 0, [&]( auto& s ) {
         s.max_supply += quantity;
     });
 
+    record_activity( _self, sym_name, activity_stake, quantity.amount, _self );
 }
 
 // reduce max supply
 void brandedtoken::subsupply(asset quantity, string memo){
-  require_auth(N(tapatalktpx1));
+  PROFILE_SECTION( "subsupply" );
+  require_supply_auth( quantity.symbol.name() );
 
   auto sym = quantity.symbol;
 
@@ -186,6 +354,7 @@ void brandedtoken::subsupply(asset quantity, string memo){
 
   auto sym_name = sym.name();
   stats statstable(_self, sym_name );
+  PROFILE_READS( 1 );
   auto existing = statstable.find( sym_name );
   eosio_assert( existing != statstable.end(), "token with symbol does not exist" );
   const auto& st = *existing;
@@ -195,103 +364,369 @@ void brandedtoken::subsupply(asset quantity, string memo){
   eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
   eosio_assert( (st.max_supply.amount - quantity.amount) >= st.supply.amount, "after reducing, max supply must be greater or equal to supply" );
 
+  PROFILE_WRITES( 1 );
   statstable.modify( st, 0, [&]( auto& s ) {
       s.max_supply -= quantity;
   });
 
+  record_activity( _self, sym_name, activity_unstake, quantity.amount, _self );
 }
 
 void brandedtoken::depbtoken(account_name btoken_from, account_name lgid_to, asset quantity) {
+  PROFILE_SECTION( "depbtoken" );
   require_auth( btoken_from );
-  
-  //Search for token balance table for ledger account existing 
-  btokenbals btokenbls( _self, quantity.symbol.name() );
-
-  auto depositlgid = btokenbls.find( lgid_to );
-  if( depositlgid == btokenbls.end() ) {
-    //Assertion. Trying to deposit to a non-existing ledger account
-    eosio_assert( false, "ledger ID doesn't exist" );
-  } else {
 
-    //Transfer token to self contract as deposit
-    transfer(btoken_from, _self, quantity, "deposit");
+  //Take token into ledger custody as deposit
+  deposit_custody( btoken_from, lgid_to, quantity );
 
-    //Update the deposit on token balance table
-    btokenbls.modify( depositlgid, 0, [&]( auto& a ) {
-      a.balance += quantity;
-    });
+  //Update the deposit on token ledger
+  add_ledger( lgid_to, quantity, btoken_from );
+
+  record_activity( _self, quantity.symbol.name(), activity_ledger, quantity.amount, btoken_from );
+}
+
+void brandedtoken::wdrbtoken(account_name lgid_from, account_name btoken_to, asset quantity, uint64_t opid) {
+  PROFILE_SECTION( "wdrbtoken" );
+  require_auth( _self );
+  if( !claim_ledger_op( _self, opid ) ) return;
+
+  //Update the withdraw on token ledger
+  sub_ledger( lgid_from, quantity );
+
+  //Pay token out of ledger custody to btoken_to EOS account
+  withdraw_custody( lgid_from, btoken_to, quantity );
+
+  record_activity( _self, quantity.symbol.name(), activity_ledger, quantity.amount, lgid_from );
+}
+
+
+void brandedtoken::trfbtoken(account_name lgid_from, account_name lgid_to, asset quantity, uint64_t opid) {
+  PROFILE_SECTION( "trfbtoken" );
+  require_auth( _self );
+  eosio_assert( lgid_from != lgid_to, "cannot transfer to self" );
+  eosio_assert( quantity.is_valid(), "invalid quantity" );
+  eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
+  if( !claim_ledger_op( _self, opid ) ) return;
+
+  //Sub from lgid_from, then add to lgid_to
+  sub_ledger( lgid_from, quantity );
+  add_ledger( lgid_to, quantity, _self );
+
+  //Tips received build the recipient's reputation
+  add_reputation( quantity.symbol.name(), lgid_to, quantity.amount );
+
+  record_activity( _self, quantity.symbol.name(), activity_ledger, quantity.amount, lgid_from );
+}
+
+void brandedtoken::hold(account_name lgid, asset quantity, uint64_t holdid, uint32_t expires) {
+  PROFILE_SECTION( "hold" );
+  require_auth( _self );
+  eosio_assert( quantity.is_valid(), "invalid quantity" );
+  eosio_assert( quantity.amount > 0, "must hold positive quantity" );
+  uint32_t t = now();
+  eosio_assert( expires > t && expires - t <= max_hold_duration, "hold expiry out of range" );
+
+  btokenlgrs ledgers( _self, quantity.symbol );
+  auto from = find_ledger( ledgers, quantity.symbol, lgid );
+  eosio_assert( from != ledgers.end(), "ledger ID doesn't exist" );
+
+  uint32_t holdcount;
+  int64_t held = held_amount( quantity.symbol, lgid, holdcount );
+  eosio_assert( holdcount < max_ledger_holds, "too many holds on ledger ID" );
+  eosio_assert( from->amount - held >= quantity.amount, "overdrawn balance" );
+
+  holds hldtbl( _self, quantity.symbol );
+  PROFILE_READS( 1 );
+  eosio_assert( hldtbl.find( holdid ) == hldtbl.end(), "hold ID already exists" );
+  PROFILE_WRITES( 1 );
+  hldtbl.emplace( _self, [&]( auto& h ){
+    h.id = holdid;
+    h.lgid = lgid;
+    h.amount = quantity.amount;
+    h.expires = expires;
+  });
+}
+
+void brandedtoken::capture(symbol_type symbolo, vector<holdcapture> captures) {
+  PROFILE_SECTION( "capture" );
+  require_auth( _self );
+  eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+  eosio_assert( captures.size() <= max_capture_batch, "too many captures" );
+
+  holds hldtbl( _self, symbolo );
+  uint32_t t = now();
+  //A shop's batch mostly pays a few ledgers, so credits are summed per recipient
+  struct credit {
+    account_name lgid;
+    int64_t      amount;
+    int64_t      points;
+  };
+  vector<credit> credits;
+  for( const auto& c : captures ) {
+    PROFILE_READS( 1 );
+    auto h = hldtbl.find( c.holdid );
+    if( h == hldtbl.end() ) continue;
+    bool live = h->expires > t;
+    eosio_assert( !live || (c.amount > 0 && c.amount <= h->amount), "capture outside 0..held amount" );
+    account_name lgid = h->lgid;
+    PROFILE_WRITES( 1 );
+    hldtbl.erase( *h );
+    if( !live ) continue;
+
+    //The hold is gone, so the debit only has to fit beside the ledger's other holds
+    sub_ledger( lgid, asset{c.amount, symbolo} );
+    record_activity( _self, symbolo.name(), activity_ledger, c.amount, lgid );
+
+    //Capturing into the held ledger itself earns no reputation
+    int64_t points = c.lgid_to == lgid ? 0 : c.amount;
+    auto cr = std::find_if( credits.begin(), credits.end(), [&]( const auto& p ) { return p.lgid == c.lgid_to; } );
+    if( cr == credits.end() ) credits.push_back( credit{ c.lgid_to, c.amount, points } );
+    else {
+      cr->amount += c.amount;
+      cr->points += points;
+    }
+  }
+
+  for( const auto& cr : credits ) {
+    add_ledger( cr.lgid, asset{cr.amount, symbolo}, _self );
+    if( cr.points > 0 ) add_reputation( symbolo.name(), cr.lgid, cr.points );
   }
 }
 
-void brandedtoken::wdrbtoken(account_name lgid_from, account_name btoken_to, asset quantity) {
+void brandedtoken::release(symbol_type symbolo, vector<uint64_t> holdids) {
+  PROFILE_SECTION( "release" );
   require_auth( _self );
+  eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+  eosio_assert( holdids.size() <= max_capture_batch, "too many hold IDs" );
+
+  holds hldtbl( _self, symbolo );
+  for( auto holdid : holdids ) {
+    PROFILE_READS( 1 );
+    auto h = hldtbl.find( holdid );
+    if( h == hldtbl.end() ) continue;
+    PROFILE_WRITES( 1 );
+    hldtbl.erase( *h );
+  }
+}
+
+int64_t brandedtoken::held_amount( symbol_type sym, account_name lgid, uint32_t& count ) {
+  PROFILE_SECTION( "held_amount" );
+  holds hldtbl( _self, sym );
+  auto byledger = hldtbl.get_index<N(byledger)>();
+  uint32_t t = now();
+  int64_t held = 0;
+  count = 0;
+
+  //Expired holds sort first, drop them now that the ledger is touched
+  PROFILE_READS( 1 );
+  auto it = byledger.lower_bound( hold_key( lgid, 0 ) );
+  while( it != byledger.end() && it->lgid == lgid ) {
+    if( it->expires <= t ) {
+      PROFILE_READS( 1 );
+      PROFILE_WRITES( 1 );
+      it = byledger.erase( it );
+      continue;
+    }
+    held += it->amount;
+    count++;
+    PROFILE_READS( 1 );
+    it++;
+  }
+  return held;
+}
 
-  //Search for token balance table for ledger account existing 
-  btokenbals btokenbls( _self, quantity.symbol.name() );
+int64_t brandedtoken::live_held( symbol_type sym, account_name lgid ) {
+  PROFILE_SECTION( "live_held" );
+  holds hldtbl( _self, sym );
+  auto byledger = hldtbl.get_index<N(byledger)>();
+  int64_t held = 0;
+
+  //Like held_amount but for queries, start past the expired holds instead of pruning them
+  PROFILE_READS( 1 );
+  auto it = byledger.lower_bound( hold_key( lgid, uint64_t(now()) + 1 ) );
+  while( it != byledger.end() && it->lgid == lgid ) {
+    held += it->amount;
+    PROFILE_READS( 1 );
+    it++;
+  }
+  return held;
+}
 
-  auto withdrawlgid = btokenbls.find( lgid_from );
-  if( withdrawlgid == btokenbls.end() ) {
-    //Assertion. Trying to withdraw from a non-existing ledger account
-    eosio_assert( false, "ledger ID doesn't exist" );
+void brandedtoken::add_reputation( symbol_name sym, account_name lgid, uint64_t points ) {
+  PROFILE_SECTION( "add_reputation" );
+  reputations reptable( _self, sym );
+  PROFILE_READS( 1 );
+  auto rep = reptable.find( lgid );
+  uint32_t t = now();
+  if( rep == reptable.end() ) {
+    PROFILE_WRITES( 1 );
+    reptable.emplace( _self, [&]( auto& r ){
+      r.lgid = lgid;
+      r.score = points;
+      r.updated = t;
+    });
   } else {
-    //Update the withdraw on token balance table
-    btokenbls.modify( withdrawlgid, 0, [&]( auto& a ) {
-      eosio_assert( a.balance.amount >= quantity.amount, "overdrawn balance" );
-      a.balance -= quantity;
+    //Apply the decay owed since the last update, then accumulate
+    PROFILE_WRITES( 1 );
+    reptable.modify( rep, 0, [&]( auto& r ) {
+      r.score = add_score( decay_score( r.score, t - r.updated, reputation_half_life ), points );
+      r.updated = t;
     });
+  }
+}
 
-    //Transfer token from self contract to btoken_to EOS account
-    transfer(_self, btoken_to, quantity, "withdraw");
+brandedtoken::btokenlgrs::const_iterator brandedtoken::find_ledger( btokenlgrs& ledgers, symbol_type sym, account_name lgid ) {
+  PROFILE_SECTION( "find_ledger" );
+  PROFILE_READS( 1 );
+  auto it = ledgers.find( lgid );
+  if( it != ledgers.end() ) return it;
+
+  //Dormant, promote it back to a hot row
+  btokencolds cold( _self, sym );
+  int64_t amount;
+  if( take_cold( cold, lgid, amount ) ) {
+    PROFILE_WRITES( 1 );
+    return ledgers.emplace( _self, [&]( auto& a ){
+      a.lgid = lgid;
+      a.amount = amount;
+    });
   }
 
+  //Not migrated yet, move the legacy row over on first touch
+  btokenbals btokenbls( _self, sym.name() );
+  PROFILE_READS( 1 );
+  auto legacy = btokenbls.find( lgid );
+  if( legacy == btokenbls.end() || legacy->balance.symbol != sym ) return it;
+
+  PROFILE_WRITES( 1 );
+  it = ledgers.emplace( _self, [&]( auto& a ){
+    a.lgid = lgid;
+    a.amount = legacy->balance.amount;
+  });
+  PROFILE_WRITES( 1 );
+  btokenbls.erase( *legacy );
+  return it;
+}
+
+void brandedtoken::sub_ledger( account_name lgid, asset value ) {
+  PROFILE_SECTION( "sub_ledger" );
+  btokenlgrs ledgers( _self, value.symbol );
+  auto from = find_ledger( ledgers, value.symbol, lgid );
+  eosio_assert( from != ledgers.end(), "ledger ID doesn't exist" );
+
+  //Held balance is reserved for capture, only the rest can be spent
+  uint32_t holdcount;
+  eosio_assert( from->amount - held_amount( value.symbol, lgid, holdcount ) >= value.amount, "overdrawn balance" );
+
+  PROFILE_WRITES( 1 );
+  ledgers.modify( from, 0, [&]( auto& a ) {
+    a.amount -= value.amount;
+  });
+}
+
+void brandedtoken::add_ledger( account_name lgid, asset value, account_name ram_payer ) {
+  PROFILE_SECTION( "add_ledger" );
+  btokenlgrs ledgers( _self, value.symbol );
+  auto to = find_ledger( ledgers, value.symbol, lgid );
+
+  PROFILE_WRITES( 1 );
+  if( to == ledgers.end() ) {
+    //First credit opens the ledger, billed to the account that authorized the credit
+    ledgers.emplace( ram_payer, [&]( auto& a ){
+      a.lgid = lgid;
+      a.amount = value.amount;
+    });
+    return;
+  }
+  ledgers.modify( to, 0, [&]( auto& a ) {
+    a.amount += value.amount;
+  });
 }
 
+void brandedtoken::crtstream(account_name payer, account_name payee, asset quantity, uint32_t start, uint32_t end) {
+  PROFILE_SECTION( "crtstream" );
+  require_auth( _self );
+  eosio_assert( quantity.is_valid(), "invalid quantity" );
+  eosio_assert( quantity.amount > 0, "must stream positive quantity" );
+  eosio_assert( payer != payee, "cannot stream to self" );
+  eosio_assert( end > start, "stream must end after it starts" );
+
+  //Escrow the whole stream from the payer up front, the payee's ledger opens on its first claim
+  sub_ledger( payer, quantity );
+
+  streams strtbl( _self, quantity.symbol.name() );
+  PROFILE_READS( 1 );
+  PROFILE_WRITES( 1 );
+  strtbl.emplace( _self, [&]( auto& s ){
+    s.id = strtbl.available_primary_key();
+    s.payer = payer;
+    s.payee = payee;
+    s.deposit = quantity;
+    s.withdrawn = asset(0, quantity.symbol);
+    s.start = start;
+    s.end = end;
+  });
+}
 
-void brandedtoken::trfbtoken(account_name lgid_from, account_name lgid_to, asset quantity) {
+void brandedtoken::claimstream(symbol_type symbolo, uint64_t id) {
+  PROFILE_SECTION( "claimstream" );
   require_auth( _self );
 
-  //Search for token balance table for ledger account existing 
-  btokenbals btokenbls( _self, quantity.symbol.name() );
+  streams strtbl( _self, symbolo.name() );
+  PROFILE_READS( 1 );
+  const auto& st = strtbl.get( id, "stream doesn't exist" );
 
-  auto sublgid = btokenbls.find( lgid_from );
-  if( sublgid == btokenbls.end() ) {
-    //Assertion. Trying to sub from a non-existing ledger account
-    eosio_assert( false, "ledger ID doesn't exist" );
-  } else {
-    //Search for token balance table for receive ledger account existing 
-    auto addlgid = btokenbls.find( lgid_to );
-    if( addlgid == btokenbls.end() ) {
-      //Assertion. Trying to add to a non-existing ledger account
-      eosio_assert( false, "ledger ID doesn't exist" );
-    } else {
-      //Sub from ledger account on token balance table
-      btokenbls.modify( sublgid, 0, [&]( auto& a ) {
-        eosio_assert( a.balance.amount >= quantity.amount, "overdrawn balance" );
-        a.balance -= quantity;
-      });
+  asset owed = st.vested( now() ) - st.withdrawn;
+  eosio_assert( owed.amount > 0, "nothing to claim" );
 
-      //Then add the balance
-      btokenbls.modify( addlgid, 0, [&]( auto& a ) {
-        a.balance += quantity;
-      });
-    }
+  add_ledger( st.payee, owed, _self );
+  record_activity( _self, symbolo.name(), activity_ledger, owed.amount, st.payer );
 
+  if( st.withdrawn + owed == st.deposit ) {
+    PROFILE_WRITES( 1 );
+    strtbl.erase( st );
+  } else {
+    PROFILE_WRITES( 1 );
+    strtbl.modify( st, 0, [&]( auto& s ) {
+      s.withdrawn += owed;
+    });
   }
 }
 
+void brandedtoken::cancelstream(symbol_type symbolo, uint64_t id) {
+  PROFILE_SECTION( "cancelstream" );
+  require_auth( _self );
+
+  streams strtbl( _self, symbolo.name() );
+  PROFILE_READS( 1 );
+  const auto& st = strtbl.get( id, "stream doesn't exist" );
+
+  asset vested = st.vested( now() );
+  asset owed = vested - st.withdrawn;
+  asset refund = st.deposit - vested;
+
+  if( owed.amount > 0 ) add_ledger( st.payee, owed, _self );
+  if( refund.amount > 0 ) add_ledger( st.payer, refund, _self );
+
+  PROFILE_WRITES( 1 );
+  strtbl.erase( st );
+}
+
 void brandedtoken::createlgid(account_name lgid, symbol_type symbolo) {
+  PROFILE_SECTION( "createlgid" );
   require_auth( _self );
-  
-  //Search for gdp balance table for ledger account existing 
-  btokenbals btokenbls( _self, symbolo.name() );
+  eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+
+  //Search for token ledger for ledger account existing 
+  btokenlgrs ledgers( _self, symbolo );
 
-  auto newlgid = btokenbls.find( lgid );
-  if( newlgid == btokenbls.end() ) {
+  auto newlgid = find_ledger( ledgers, symbolo, lgid );
+  if( newlgid == ledgers.end() ) {
     //If account does not existing, create new ledger account
-    asset emptyasset = asset(0, symbolo);
-    btokenbls.emplace( _self, [&]( auto& a ){
-      a.balance = emptyasset;
+    PROFILE_WRITES( 1 );
+    ledgers.emplace( _self, [&]( auto& a ){
       a.lgid = lgid;
+      a.amount = 0;
     });
   } else {
     //Assertion. Trying to create redundant ledger account
@@ -299,6 +734,206 @@ void brandedtoken::createlgid(account_name lgid, symbol_type symbolo) {
   }
 }
 
+void brandedtoken::migrate(symbol_type symbolo, uint32_t max_rows) {
+  PROFILE_SECTION( "migrate" );
+  require_auth( _self );
+
+  btokenbals btokenbls( _self, symbolo.name() );
+  btokenlgrs ledgers( _self, symbolo );
+
+  PROFILE_READS( 1 );
+  auto legacy = btokenbls.begin();
+  for( uint32_t n = 0; n < max_rows && legacy != btokenbls.end(); ++n ) {
+    eosio_assert( legacy->balance.symbol == symbolo, "symbol precision mismatch" );
+    PROFILE_WRITES( 1 );
+    ledgers.emplace( _self, [&]( auto& a ){
+      a.lgid = legacy->lgid;
+      a.amount = legacy->balance.amount;
+    });
+    PROFILE_READS( 1 );
+    PROFILE_WRITES( 1 );
+    legacy = btokenbls.erase( legacy );
+  }
+}
+
+brandedtoken::cledgers::const_iterator brandedtoken::find_cid( cledgers& cltbls, lgkey lgid, symbol_type sym ) {
+  PROFILE_SECTION( "find_cid" );
+  auto byledger = cltbls.get_index<N(byledger)>();
+
+  //A (community, user) pair mostly holds only its community's brand, the scan is short
+  PROFILE_READS( 1 );
+  auto it = byledger.lower_bound( ledger_key( lgid.community, lgid.user ) );
+  while( it != byledger.end() && it->community == lgid.community && it->user == lgid.user ) {
+    if( it->symbol == sym ) return cltbls.iterator_to( *it );
+    PROFILE_READS( 1 );
+    it++;
+  }
+  return cltbls.end();
+}
+
+void brandedtoken::sub_cid( lgkey lgid, asset value ) {
+  PROFILE_SECTION( "sub_cid" );
+  cledgers cltbls( _self, _self );
+  auto from = find_cid( cltbls, lgid, value.symbol );
+  eosio_assert( from != cltbls.end(), "ledger ID doesn't exist" );
+  eosio_assert( from->amount >= value.amount, "overdrawn balance" );
+
+  PROFILE_WRITES( 1 );
+  cltbls.modify( from, 0, [&]( auto& a ) {
+    a.amount -= value.amount;
+  });
+}
+
+void brandedtoken::add_cid( lgkey lgid, asset value, account_name ram_payer ) {
+  PROFILE_SECTION( "add_cid" );
+  cledgers cltbls( _self, _self );
+  auto to = find_cid( cltbls, lgid, value.symbol );
+
+  if( to == cltbls.end() ) {
+    //First credit opens the ledger, billed to the account that authorized the credit
+    PROFILE_READS( 1 );
+    PROFILE_WRITES( 1 );
+    cltbls.emplace( ram_payer, [&]( auto& a ){
+      a.id = cltbls.available_primary_key();
+      a.community = lgid.community;
+      a.user = lgid.user;
+      a.symbol = value.symbol;
+      a.amount = value.amount;
+    });
+    return;
+  }
+  PROFILE_WRITES( 1 );
+  cltbls.modify( to, 0, [&]( auto& a ) {
+    a.amount += value.amount;
+  });
+}
+
+void brandedtoken::createcid(lgkey lgid, symbol_type symbolo) {
+  PROFILE_SECTION( "createcid" );
+  require_auth( _self );
+  eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+
+  cledgers cltbls( _self, _self );
+  eosio_assert( find_cid( cltbls, lgid, symbolo ) == cltbls.end(), "ledger ID already exists" );
+
+  PROFILE_READS( 1 );
+  PROFILE_WRITES( 1 );
+  cltbls.emplace( _self, [&]( auto& a ){
+    a.id = cltbls.available_primary_key();
+    a.community = lgid.community;
+    a.user = lgid.user;
+    a.symbol = symbolo;
+    a.amount = 0;
+  });
+}
+
+void brandedtoken::depcid(account_name btoken_from, lgkey lgid_to, asset quantity) {
+  PROFILE_SECTION( "depcid" );
+  require_auth( btoken_from );
+
+  //Take token into ledger custody as deposit
+  deposit_custody( btoken_from, lgid_to.user, quantity );
+
+  //Update the deposit on community ledger
+  add_cid( lgid_to, quantity, btoken_from );
+
+  record_activity( _self, quantity.symbol.name(), activity_ledger, quantity.amount, btoken_from );
+}
+
+void brandedtoken::wdrcid(lgkey lgid_from, account_name btoken_to, asset quantity, uint64_t opid) {
+  PROFILE_SECTION( "wdrcid" );
+  require_auth( _self );
+  if( !claim_ledger_op( _self, opid ) ) return;
+
+  //Update the withdraw on community ledger
+  sub_cid( lgid_from, quantity );
+
+  //Pay token out of ledger custody to btoken_to EOS account
+  withdraw_custody( lgid_from.user, btoken_to, quantity );
+
+  record_activity( _self, quantity.symbol.name(), activity_ledger, quantity.amount, lgid_from.user );
+}
+
+void brandedtoken::trfcid(lgkey lgid_from, lgkey lgid_to, asset quantity, uint64_t opid) {
+  PROFILE_SECTION( "trfcid" );
+  require_auth( _self );
+  eosio_assert( lgid_from.community != lgid_to.community || lgid_from.user != lgid_to.user, "cannot transfer to self" );
+  eosio_assert( quantity.is_valid(), "invalid quantity" );
+  eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
+  if( !claim_ledger_op( _self, opid ) ) return;
+
+  //Sub from lgid_from, then add to lgid_to
+  sub_cid( lgid_from, quantity );
+  add_cid( lgid_to, quantity, _self );
+
+  record_activity( _self, quantity.symbol.name(), activity_ledger, quantity.amount, lgid_from.user );
+}
+
+void brandedtoken::demote(symbol_type symbolo, vector<account_name> lgids) {
+  PROFILE_SECTION( "demote" );
+  require_auth( _self );
+  eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+  eosio_assert( lgids.size() <= cold_demote_batch, "too many ledger IDs" );
+
+  btokenlgrs ledgers( _self, symbolo );
+  btokencolds cold( _self, symbolo );
+  for( auto lgid : lgids ) {
+    PROFILE_READS( 1 );
+    auto it = ledgers.find( lgid );
+    if( it == ledgers.end() ) continue;
+
+    put_cold( cold, _self, lgid, it->amount );
+    PROFILE_WRITES( 1 );
+    ledgers.erase( *it );
+  }
+}
+
+void brandedtoken::getbalances(symbol_type symbolo, vector<account_name> owners, vector<account_name> lgids) {
+  PROFILE_SECTION( "getbalances" );
+  eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+  eosio_assert( owners.size() + lgids.size() <= max_query_keys, "too many keys" );
+
+  balance_page page;
+  page.accounts.reserve( owners.size() );
+  for( auto owner : owners ) {
+    accounts acnts( _self, owner );
+    PROFILE_READS( 1 );
+    auto it = acnts.find( symbolo.name() );
+    page.accounts.push_back( it == acnts.end() || it->balance.symbol != symbolo ? asset{0, symbolo} : it->balance );
+  }
+
+  //Read cold and legacy rows in place, a query never promotes or migrates
+  btokenlgrs ledgers( _self, symbolo );
+  btokencolds cold( _self, symbolo );
+  btokenbals btokenbls( _self, symbolo.name() );
+  page.ledgers.reserve( lgids.size() );
+  page.held.reserve( lgids.size() );
+  page.reputations.reserve( lgids.size() );
+  for( auto lgid : lgids ) {
+    asset balance{0, symbolo};
+    PROFILE_READS( 1 );
+    auto it = ledgers.find( lgid );
+    auto row = it == ledgers.end() ? cold_row_of( cold, lgid ) : cold.end();
+    PROFILE_READS( it == ledgers.end() ? 1 : 0 );
+    if( it != ledgers.end() ) {
+      balance.amount = it->amount;
+    } else if( row != cold.end() && row->has( lgid ) ) {
+      balance.amount = row->amount_of( lgid );
+    } else {
+      PROFILE_READS( 1 );
+      auto legacy = btokenbls.find( lgid );
+      if( legacy != btokenbls.end() && legacy->balance.symbol == symbolo ) balance.amount = legacy->balance.amount;
+    }
+    asset held{live_held( symbolo, lgid ), symbolo};
+    page.ledgers.push_back( balance - held );
+    page.held.push_back( held );
+    PROFILE_READS( 1 );
+    page.reputations.push_back( get_reputation( lgid, symbolo.name() ) );
+  }
+
+  return_value( page );
+}
+
 } /// namespace eosio
 
-EOSIO_ABI( eosio::brandedtoken, (create)(issue)(transfer)(open)(close)(retire)(addsupply)(subsupply)(depbtoken)(wdrbtoken)(trfbtoken)(createlgid))
+EOSIO_ABI( eosio::brandedtoken, (create)(issue)(mint)(transfer)(open)(close)(retire)(addsupply)(subsupply)(setbrand)(depbtoken)(wdrbtoken)(trfbtoken)(hold)(capture)(release)(createlgid)(migrate)(createcid)(depcid)(wdrcid)(trfcid)(crtstream)(claimstream)(cancelstream)(getbalances)(demote))
@@ -6,7 +6,17 @@
 #include <eosiolib/asset.hpp>
 #include <eosiolib/eosio.hpp>
 
+#include "../../common/activity.hpp"
+#include "../../common/coldtier.hpp"
+#include "../../common/custody.hpp"
+#include "../../common/decay.hpp"
+#include "../../common/dedup.hpp"
+#include "../../common/profile.hpp"
+#include "../../common/query.hpp"
+
+#include <algorithm>
 #include <string>
+#include <vector>
 
 namespace eosiosystem {
    class system_contract;
@@ -15,10 +25,66 @@ namespace eosiosystem {
 namespace eosio {
 
    using std::string;
+   using std::vector;
 
    class brandedtoken : public contract {
       public:
+         /**
+         * Return value of getbalances, in key order, zero for missing rows.
+         * ledgers holds what each ledger can spend, its balance less its live
+         * holds, and held those holds. reputations holds each ledger's tipping
+         * reputation, decayed to now.
+         **/
+         struct balance_page {
+            vector<asset>      accounts;
+            vector<asset>      ledgers;
+            vector<asset>      held;
+            vector<uint64_t>   reputations;
+
+            EOSLIB_SERIALIZE( balance_page, (accounts)(ledgers)(held)(reputations))
+         };
+
+         /**
+         * Cross-community ledger ID, community ID plus platform user ID
+         **/
+         struct lgkey {
+            uint64_t  community;
+            uint64_t  user;
+
+            EOSLIB_SERIALIZE( lgkey, (community)(user))
+         };
+
+         /**
+         * One recipient of mint, amount in the minted symbol's units
+         **/
+         struct mintentry {
+            account_name  to;
+            int64_t       amount;
+
+            EOSLIB_SERIALIZE( mintentry, (to)(amount))
+         };
+
+         /**
+         * One hold settled by capture, amount up to the held amount, the rest is released
+         **/
+         struct holdcapture {
+            uint64_t      holdid;
+            account_name  lgid_to;
+            int64_t       amount;
+
+            EOSLIB_SERIALIZE( holdcapture, (holdid)(lgid_to)(amount))
+         };
+
          brandedtoken( account_name self ):contract(self){}
+
+#ifdef BRANDEDTOKEN_SINGLE_SYMBOL
+         /**
+         * Single-symbol build, e.g. -DBRANDEDTOKEN_SINGLE_SYMBOL='S(4,GDP)'.
+         * The contract only hosts this symbol, so transfer checks precision
+         * without reading the stat table.
+         **/
+         static constexpr uint64_t brand_symbol = BRANDEDTOKEN_SINGLE_SYMBOL;
+#endif
          /**
          * Standard token contract - create
          *
@@ -39,6 +105,18 @@ namespace eosio {
          [[eosio::action]]
          void issue( account_name to, asset quantity, string memo );
 
+         /**
+         * Airdrop: issue straight into many EOS accounts and ledger accounts,
+         * with a single supply update for the whole batch
+         *
+         * @param symbolo   brand token symbol, format : "0.0000 XXX"
+         * @param accounts  EOS account recipients, each must exist
+         * @param lgids     ledger account recipients, backed by the custody stripes of their ledgers; the issuer pays the RAM of ledgers the drop opens
+         * @param memo      memo
+         **/
+         [[eosio::action]]
+         void mint( symbol_type symbolo, vector<mintentry> accounts, vector<mintentry> lgids, string memo );
+
          /**
          * Standard token contract - retire
          *
@@ -99,10 +177,19 @@ namespace eosio {
          [[eosio::action]]
          void subsupply(asset quantity, string memo);
 
+         /**
+         * Brand token contract - register or update a hosted brand
+         *
+         * @param symbolo     brand token symbol, must be created first
+         * @param supplyauth  account allowed to add/sub supply, normally the TAPx contract
+         */
+         [[eosio::action]]
+         void setbrand(symbol_type symbolo, account_name supplyauth);
+
          /**
          * Deposit brand token from EOS account to ledger account
          *
-         * @param btoken_from  EOS account that send brand token
+         * @param btoken_from  EOS account that send brand token, pays the RAM of a ledger the deposit opens
          * @param lgid_to    ledger account that receive brand token
          * @param quantity  deposit asset quantity
          **/
@@ -115,9 +202,10 @@ namespace eosio {
          * @param lgid_from  ledger account that send brand token
          * @param btoken_to  EOS account that receive brand token
          * @param quantity  withdraw asset quantity
+         * @param opid  client operation id, a replay within the dedup window is a no-op; 0 for none
          **/
          [[eosio::action]]
-         void wdrbtoken(account_name lgid_from, account_name btoken_to, asset quantity);
+         void wdrbtoken(account_name lgid_from, account_name btoken_to, asset quantity, uint64_t opid);
 
          /**
          * Transfer brand token between ledger accounts
@@ -125,12 +213,45 @@ namespace eosio {
          * @param lgid_from  ledger account that send brand token
          * @param lgid_to  ledger account that receive brand token
          * @param quantity  transfer asset quantity
+         * @param opid  client operation id, a replay within the dedup window is a no-op; 0 for none
          **/
          [[eosio::action]]
-         void trfbtoken(account_name lgid_from, account_name lgid_to, asset quantity);
+         void trfbtoken(account_name lgid_from, account_name lgid_to, asset quantity, uint64_t opid);
 
          /**
-         * Create new account on ledger
+         * Reserve part of a ledger balance, e.g. for a purchase confirmed off chain.
+         * Held balance can't be spent until it is captured, released or expires.
+         *
+         * @param lgid      ledger account the hold is placed on
+         * @param quantity  held asset quantity
+         * @param holdid    client hold id, e.g. the order id, unique per symbol
+         * @param expires   expiry, seconds since epoch, at most max_hold_duration ahead
+         **/
+         [[eosio::action]]
+         void hold(account_name lgid, asset quantity, uint64_t holdid, uint32_t expires);
+
+         /**
+         * Settle holds as ledger transfers in one action. Holds that are gone or
+         * expired are skipped, so a resubmitted batch settles nothing twice.
+         *
+         * @param symbolo   brand token symbol of the holds
+         * @param captures  up to max_capture_batch holds to settle
+         **/
+         [[eosio::action]]
+         void capture(symbol_type symbolo, vector<holdcapture> captures);
+
+         /**
+         * Drop holds without moving any balance, e.g. for a refund. Missing holds are skipped.
+         *
+         * @param symbolo  brand token symbol of the holds
+         * @param holdids  up to max_capture_batch hold ids
+         **/
+         [[eosio::action]]
+         void release(symbol_type symbolo, vector<uint64_t> holdids);
+
+         /**
+         * Create new account on ledger ahead of its first credit. Optional,
+         * every ledger credit opens the recipient's ledger itself
          *
          * @param ledger  new ledger ID
          * @param symbol_type   brand token symbol, format : "0.0000 XXX"
@@ -138,10 +259,130 @@ namespace eosio {
          [[eosio::action]]
          void createlgid(account_name lgid, symbol_type symbolo);
 
+         /**
+         * Move legacy btokenbals rows of a symbol to the compact btokenlgrs table
+         *
+         * @param symbolo   brand token symbol, format : "0.0000 XXX"
+         * @param max_rows  rows to move in this action
+         **/
+         [[eosio::action]]
+         void migrate(symbol_type symbolo, uint32_t max_rows);
+
+         /**
+         * Create new (community, user) account on ledger ahead of its first
+         * credit. Optional, depcid and trfcid open the recipient's ledger themselves
+         *
+         * @param lgid     new community ledger ID
+         * @param symbolo  brand token symbol, format : "0.0000 XXX"
+         **/
+         [[eosio::action]]
+         void createcid(lgkey lgid, symbol_type symbolo);
+
+         /**
+         * Deposit brand token from EOS account to (community, user) ledger account
+         *
+         * @param btoken_from  EOS account that send brand token, pays the RAM of a ledger the deposit opens
+         * @param lgid_to      community ledger account that receive brand token
+         * @param quantity     deposit asset quantity
+         **/
+         [[eosio::action]]
+         void depcid(account_name btoken_from, lgkey lgid_to, asset quantity);
+
+         /**
+         * Withdraw brand token from (community, user) ledger account to EOS account
+         *
+         * @param lgid_from  community ledger account that send brand token
+         * @param btoken_to  EOS account that receive brand token
+         * @param quantity   withdraw asset quantity
+         * @param opid       client operation id, a replay within the dedup window is a no-op; 0 for none
+         **/
+         [[eosio::action]]
+         void wdrcid(lgkey lgid_from, account_name btoken_to, asset quantity, uint64_t opid);
+
+         /**
+         * Transfer brand token between (community, user) ledger accounts
+         *
+         * @param lgid_from  community ledger account that send brand token
+         * @param lgid_to    community ledger account that receive brand token
+         * @param quantity   transfer asset quantity
+         * @param opid       client operation id, a replay within the dedup window is a no-op; 0 for none
+         **/
+         [[eosio::action]]
+         void trfcid(lgkey lgid_from, lgkey lgid_to, asset quantity, uint64_t opid);
+
+         /**
+         * Stream brand token between ledger accounts, e.g. a moderator salary or stake vesting.
+         * quantity is escrowed from the payer now and vests linearly from start to end.
+         *
+         * @param payer     ledger account that funds the stream
+         * @param payee     ledger account that receives the stream
+         * @param quantity  total streamed asset quantity
+         * @param start     vesting start, seconds since epoch
+         * @param end       vesting end, seconds since epoch
+         **/
+         [[eosio::action]]
+         void crtstream(account_name payer, account_name payee, asset quantity, uint32_t start, uint32_t end);
+
+         /**
+         * Credit the payee with everything vested and not yet withdrawn
+         *
+         * @param symbolo  brand token symbol of the stream
+         * @param id       stream ID
+         **/
+         [[eosio::action]]
+         void claimstream(symbol_type symbolo, uint64_t id);
+
+         /**
+         * Stop a stream: the payee gets what has vested, the payer the rest
+         *
+         * @param symbolo  brand token symbol of the stream
+         * @param id       stream ID
+         **/
+         [[eosio::action]]
+         void cancelstream(symbol_type symbolo, uint64_t id);
+
+         /**
+         * Read-only: brand token balances of many holders in one call, returned
+         * packed as a balance_page in the action return value
+         *
+         * Covers one brand symbol. A user's (community, user) ledgers in every
+         * brand are one cledgers byuser scan instead.
+         *
+         * @param symbolo  brand token symbol, format : "0.0000 XXX"
+         * @param owners   EOS accounts
+         * @param lgids    ledger accounts
+         **/
+         [[eosio::action]]
+         void getbalances(symbol_type symbolo, vector<account_name> owners, vector<account_name> lgids);
+
+         /**
+         * Move dormant ledgers to the packed cold tier, they return to a hot row
+         * on their next ledger action. IDs not holding a hot row are skipped.
+         *
+         * @param symbolo  brand token symbol, format : "0.0000 XXX"
+         * @param lgids    up to cold_demote_batch ledger accounts
+         **/
+         [[eosio::action]]
+         void demote(symbol_type symbolo, vector<account_name> lgids);
+
+         static uint128_t ledger_key( uint64_t community, uint64_t user ) {
+            return (uint128_t(community) << 64) | user;
+         }
+
+         static uint128_t user_key( uint64_t user, symbol_name sym ) {
+            return (uint128_t(user) << 64) | sym;
+         }
+
+         static uint128_t hold_key( uint64_t lgid, uint64_t expires ) {
+            return (uint128_t(lgid) << 64) | expires;
+         }
+
          inline asset get_supply( symbol_name sym )const;
 
          inline asset get_balance( account_name owner, symbol_name sym )const;
 
+         inline uint64_t get_reputation( account_name lgid, symbol_name sym )const;
+
       private:
          struct [[eosio::table]] account {
             asset    balance;
@@ -160,12 +401,28 @@ namespace eosio {
          typedef eosio::multi_index<N(accounts), account> accounts;
          typedef eosio::multi_index<N(stat), currency_stats> stats;
 
+         //brand registry, scoped by brand symbol name like stat
+         struct [[eosio::table]] brand {
+            symbol_type     symbol;
+            account_name    supply_auth;
+
+            uint64_t primary_key()const { return symbol.name(); }
+            EOSLIB_SERIALIZE( brand, (symbol)(supply_auth))
+         };
+         typedef eosio::multi_index<N(brands), brand> brands;
+
+         void require_supply_auth( symbol_name sym )const;
+
          void sub_balance( account_name owner, asset value );
          void add_balance( account_name owner, asset value, account_name ram_payer );
+         void check_symbol( const asset& quantity )const;
+         void move_balance( account_name from, account_name to, asset quantity, string memo );
+         void deposit_custody( account_name from, uint64_t lgid, asset quantity );
+         void withdraw_custody( uint64_t lgid, account_name to, asset quantity );
 
-         //ledger brand token balance table
+         //legacy ledger brand token balance table, rows move to btokenlgrs by migrate or on first touch
          struct [[eosio::table]] btokenbal {
-            account_name    lgid;       // will create a secondary index on this
+            account_name    lgid;
             asset           balance;
 
             auto            primary_key()const { return lgid; }
@@ -173,6 +430,131 @@ namespace eosio {
          };
          typedef eosio::multi_index<N(btokenbals), btokenbal> btokenbals;
 
+         //ledger brand token balance table, scoped by the full symbol (precision and
+         //name) so rows only carry the amount and a precision mismatch finds no row.
+         //With -DBRANDEDTOKEN_LEADERBOARD, byamount ranks ledgers by balance for the
+         //brand leaderboard, at 128 bytes of RAM and one index update per change.
+         struct [[eosio::table]] btokenlgr {
+            account_name    lgid;
+            int64_t         amount;
+
+            auto            primary_key()const { return lgid; }
+            uint64_t        by_amount()const { return uint64_t(amount); }
+            EOSLIB_SERIALIZE( btokenlgr, (lgid)(amount))
+         };
+#ifdef BRANDEDTOKEN_LEADERBOARD
+         typedef eosio::multi_index<N(btokenlgrs), btokenlgr,
+            indexed_by<N(byamount), const_mem_fun<btokenlgr, uint64_t, &btokenlgr::by_amount>>
+         > btokenlgrs;
+#else
+         typedef eosio::multi_index<N(btokenlgrs), btokenlgr> btokenlgrs;
+#endif
+
+         //dormant ledger brand token balances, packed by ranges of ledger hashes, scoped like btokenlgrs
+         typedef eosio::multi_index<N(btokencolds), coldledger> btokencolds;
+
+         btokenlgrs::const_iterator find_ledger( btokenlgrs& ledgers, symbol_type sym, account_name lgid );
+
+         //Ledger reputation, scoped by ledger symbol name. score is stored as of
+         //updated and decayed lazily on the next read or write, never swept.
+         struct [[eosio::table]] reputation {
+            account_name    lgid;
+            uint64_t        score;
+            uint32_t        updated;
+
+            auto            primary_key()const { return lgid; }
+            EOSLIB_SERIALIZE( reputation, (lgid)(score)(updated))
+         };
+         typedef eosio::multi_index<N(reputations), reputation> reputations;
+
+         void add_reputation( symbol_name sym, account_name lgid, uint64_t points );
+
+         void sub_ledger( account_name lgid, asset value );
+         void add_ledger( account_name lgid, asset value, account_name ram_payer );
+
+         //ledger stream, scoped by brand symbol name. Nothing is paid per tick:
+         //the vested amount is computed from the times when claimed or canceled.
+         struct [[eosio::table]] stream {
+            uint64_t        id;
+            account_name    payer;
+            account_name    payee;
+            asset           deposit;
+            asset           withdrawn;
+            uint32_t        start;
+            uint32_t        end;
+
+            uint64_t        primary_key()const { return id; }
+            uint64_t        by_payee()const { return payee; }
+
+            asset vested( uint32_t t )const {
+               if( t <= start ) return asset( 0, deposit.symbol );
+               if( t >= end ) return deposit;
+               return asset( int64_t( uint128_t(deposit.amount) * (t - start) / (end - start) ), deposit.symbol );
+            }
+
+            EOSLIB_SERIALIZE( stream, (id)(payer)(payee)(deposit)(withdrawn)(start)(end))
+         };
+         typedef eosio::multi_index<N(streams), stream,
+            indexed_by<N(bypayee), const_mem_fun<stream, uint64_t, &stream::by_payee>>
+         > streams;
+
+         //longest a hold may reserve a balance, most live holds per ledger so the
+         //sum taken on every ledger debit stays bounded, and holds per capture/release
+         static constexpr uint32_t max_hold_duration = 7 * 24 * 3600;
+         static constexpr uint32_t max_ledger_holds = 16;
+         static constexpr uint32_t max_capture_batch = 64;
+
+         //ledger balance reserved by hold, scoped like btokenlgrs. byledger lists a
+         //ledger's holds soonest expiry first, so expired ones are pruned from the
+         //front when the ledger is next touched instead of by a sweep.
+         struct [[eosio::table]] ledgerhold {
+            uint64_t        id;
+            account_name    lgid;
+            int64_t         amount;
+            uint32_t        expires;
+
+            uint64_t        primary_key()const { return id; }
+            uint128_t       by_ledger()const { return hold_key( lgid, expires ); }
+            EOSLIB_SERIALIZE( ledgerhold, (id)(lgid)(amount)(expires))
+         };
+         typedef eosio::multi_index<N(holds), ledgerhold,
+            indexed_by<N(byledger), const_mem_fun<ledgerhold, uint128_t, &ledgerhold::by_ledger>>
+         > holds;
+
+         int64_t held_amount( symbol_type sym, account_name lgid, uint32_t& count );
+         int64_t live_held( symbol_type sym, account_name lgid );
+
+         //ledger brand token balance keyed by (community, user, symbol), all brands in the
+         //contract's own scope. byuser orders rows by (user, symbol name), so all of a
+         //user's holdings across communities and brands are one range scan, and one brand's
+         //a narrower one. byledger finds a (community, user) pair, whose rows hold one symbol
+         //each. With -DBRANDEDTOKEN_LEADERBOARD, byrank orders each community's members by
+         //balance for its leaderboard.
+         struct [[eosio::table]] cledger {
+            uint64_t        id;
+            uint64_t        community;
+            uint64_t        user;
+            symbol_type     symbol;
+            int64_t         amount;
+
+            uint64_t        primary_key()const { return id; }
+            uint128_t       by_ledger()const { return ledger_key( community, user ); }
+            uint128_t       by_user()const { return user_key( user, symbol.name() ); }
+            uint128_t       by_rank()const { return ledger_key( community, uint64_t(amount) ); }
+            EOSLIB_SERIALIZE( cledger, (id)(community)(user)(symbol)(amount))
+         };
+         typedef eosio::multi_index<N(cledgers), cledger,
+            indexed_by<N(byledger), const_mem_fun<cledger, uint128_t, &cledger::by_ledger>>,
+            indexed_by<N(byuser), const_mem_fun<cledger, uint128_t, &cledger::by_user>>
+#ifdef BRANDEDTOKEN_LEADERBOARD
+            , indexed_by<N(byrank), const_mem_fun<cledger, uint128_t, &cledger::by_rank>>
+#endif
+         > cledgers;
+
+         cledgers::const_iterator find_cid( cledgers& cltbls, lgkey lgid, symbol_type sym );
+         void sub_cid( lgkey lgid, asset value );
+         void add_cid( lgkey lgid, asset value, account_name ram_payer );
+
       public:
          struct transfer_args {
             account_name  from;
@@ -196,4 +578,12 @@ namespace eosio {
       return ac.balance;
    }
 
+   uint64_t brandedtoken::get_reputation( account_name lgid, symbol_name sym )const
+   {
+      reputations reptable( _self, sym );
+      auto rep = reptable.find( lgid );
+      if( rep == reptable.end() ) return 0;
+      return decay_score( rep->score, now() - rep->updated, reputation_half_life );
+   }
+
 } /// namespace eosio
@@ -0,0 +1,175 @@
+/**
+ *  activity.hpp
+ *  copyright TAPx.io
+ *
+ *  Time-bucketed activity aggregates shared by the TAPx contracts.
+ */
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+
+#include "profile.hpp"
+
+namespace eosio {
+
+   enum activity_kind : uint8_t {
+      activity_transfer = 0,
+      activity_ledger,
+      activity_stake,
+      activity_unstake
+   };
+
+   //bucket granularity, kept in the top byte of the bucket key
+   enum activity_level : uint8_t {
+      activity_hour = 0,
+      activity_day,
+      activity_week
+   };
+
+   static constexpr uint32_t activity_width[]     = { 3600, 24 * 3600, 7 * 24 * 3600 };
+   //buckets older than this are folded into the next level
+   static constexpr uint32_t activity_retention[] = { 2 * 24 * 3600, 35 * 24 * 3600 };
+   //at most this many buckets are folded per action
+   static constexpr uint32_t activity_rollup_batch = 4;
+
+   inline uint64_t activity_key( uint8_t level, uint32_t start ) {
+      return (uint64_t(level) << 56) | start;
+   }
+
+   //Activity of one symbol in one time bucket, scoped by symbol name
+   struct [[eosio::table]] activity {
+      uint64_t    bucket;
+      uint64_t    transfers;
+      int64_t     transfer_volume;
+      uint64_t    ledger_moves;
+      int64_t     ledger_volume;
+      uint64_t    stakes;
+      int64_t     stake_volume;
+      uint64_t    unstakes;
+      int64_t     unstake_volume;
+      uint64_t    tippers;          // HyperLogLog sketch of senders, 16 x 4-bit registers
+
+      uint64_t    primary_key()const { return bucket; }
+      uint8_t     level()const { return uint8_t(bucket >> 56); }
+      uint32_t    start()const { return uint32_t(bucket); }
+
+      void add( activity_kind kind, int64_t volume ) {
+         switch( kind ) {
+            case activity_transfer: ++transfers;    transfer_volume += volume; break;
+            case activity_ledger:   ++ledger_moves; ledger_volume   += volume; break;
+            case activity_stake:    ++stakes;       stake_volume    += volume; break;
+            case activity_unstake:  ++unstakes;     unstake_volume  += volume; break;
+         }
+      }
+
+      void add_tipper( account_name sender ) {
+         //splitmix64 finalizer spreads account names over the registers
+         uint64_t h = sender;
+         h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+         h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+         h ^= h >> 31;
+
+         uint32_t reg  = uint32_t(h & 15) * 4;
+         uint64_t rest = h >> 4;
+         uint64_t rank = 1;
+         while( rank < 15 && !(rest & 1) ) { ++rank; rest >>= 1; }
+         if( ((tippers >> reg) & 15) < rank ) {
+            tippers = (tippers & ~(15ULL << reg)) | (rank << reg);
+         }
+      }
+
+      void merge( const activity& o ) {
+         transfers       += o.transfers;
+         transfer_volume += o.transfer_volume;
+         ledger_moves    += o.ledger_moves;
+         ledger_volume   += o.ledger_volume;
+         stakes          += o.stakes;
+         stake_volume    += o.stake_volume;
+         unstakes        += o.unstakes;
+         unstake_volume  += o.unstake_volume;
+         for( uint32_t reg = 0; reg < 64; reg += 4 ) {
+            uint64_t mine = (tippers >> reg) & 15, theirs = (o.tippers >> reg) & 15;
+            if( theirs > mine ) tippers = (tippers & ~(15ULL << reg)) | (theirs << reg);
+         }
+      }
+
+      EOSLIB_SERIALIZE( activity, (bucket)(transfers)(transfer_volume)(ledger_moves)(ledger_volume)
+                                  (stakes)(stake_volume)(unstakes)(unstake_volume)(tippers))
+   };
+   typedef eosio::multi_index<N(activity), activity> activities;
+
+   /**
+   * Fold expired buckets of one level into the next, oldest first
+   *
+   * Called when a new bucket of that level is opened, so the work is
+   * amortized to O(1) per recorded event.
+   **/
+   inline void rollup_activity( activities& acts, account_name payer, uint8_t level, uint32_t t ) {
+      if( level >= activity_week ) return;
+      uint32_t cutoff = t > activity_retention[level] ? t - activity_retention[level] : 0;
+
+      PROFILE_READS( 1 );
+      auto it = acts.lower_bound( activity_key( level, 0 ) );
+      for( uint32_t n = 0; n < activity_rollup_batch && it != acts.end() &&
+                           it->level() == level && it->start() < cutoff; ++n ) {
+         //the coarse bucket lookup and erase's step to the next row
+         PROFILE_READS( 2 );
+         PROFILE_WRITES( 2 );
+         uint32_t start = it->start() - it->start() % activity_width[level + 1];
+         uint64_t key   = activity_key( level + 1, start );
+
+         auto coarse = acts.find( key );
+         if( coarse == acts.end() ) {
+            const activity& fine = *it;
+            acts.emplace( payer, [&]( auto& a ) {
+               a = fine;
+               a.bucket = key;
+            });
+            rollup_activity( acts, payer, level + 1, t );
+         } else {
+            acts.modify( coarse, 0, [&]( auto& a ) {
+               a.merge( *it );
+            });
+         }
+         it = acts.erase( it );
+      }
+   }
+
+   /**
+   * Add one event to the current hour bucket of a symbol
+   *
+   * @param code    contract account, also pays for new buckets
+   * @param sym     symbol name the activity is scoped by
+   * @param kind    event kind
+   * @param volume  event amount in the symbol's units
+   * @param sender  account or ledger ID, counted as an active tipper for
+   *                transfers and ledger moves
+   **/
+   inline void record_activity( account_name code, symbol_name sym, activity_kind kind,
+                                int64_t volume, account_name sender ) {
+      PROFILE_SECTION( "record_activity" );
+      activities acts( code, sym );
+      uint32_t t = now();
+      uint64_t key = activity_key( activity_hour, t - t % activity_width[activity_hour] );
+
+      auto it = acts.find( key );
+      PROFILE_READS( 1 );
+      PROFILE_WRITES( 1 );
+      if( it == acts.end() ) {
+         acts.emplace( code, [&]( auto& a ) {
+            a = activity{};
+            a.bucket = key;
+            a.add( kind, volume );
+            if( kind <= activity_ledger ) a.add_tipper( sender );
+         });
+         //first event of a new hour, fold what has aged out
+         rollup_activity( acts, code, activity_hour, t );
+      } else {
+         acts.modify( it, 0, [&]( auto& a ) {
+            a.add( kind, volume );
+            if( kind <= activity_ledger ) a.add_tipper( sender );
+         });
+      }
+   }
+
+} /// namespace eosio
@@ -0,0 +1,138 @@
+/**
+ *  coldtier.hpp
+ *  copyright TAPx.io
+ *
+ *  Packed storage for dormant ledger balances. Ledger IDs are hashed and
+ *  each cold row keeps the IDs and balances of one range of hashes side by
+ *  side, 16 bytes per ledger. A row holds at most cold_row_cap ledgers and
+ *  is split in two when it fills, so the number of rows follows the number
+ *  of dormant ledgers and a demote or promote rewrites at most one row of
+ *  cold_row_cap ledgers. Split rows hold 32 to 64 ledgers and a dormant
+ *  ledger costs about 18 bytes of RAM, against 124 for a hot row; a row
+ *  holding a single ledger costs the same as that ledger's hot row.
+ */
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "profile.hpp"
+
+namespace eosio {
+
+   //most ledgers one cold row holds before it is split in two
+   static constexpr uint32_t cold_row_cap = 64;
+   //most ledgers one demote action moves
+   static constexpr uint32_t cold_demote_batch = 64;
+
+   //Balances of the ledgers whose hash falls in one range, scoped like the
+   //hot ledger table. Ledger IDs are name encoded and their low bits mostly
+   //zero, so rows are ordered by a hash of the whole ID and the ID is kept in
+   //the row. A row is keyed by the highest hash it may hold and covers the
+   //hashes above the previous row's key; the highest row is keyed ~0.
+   //ids is sorted by hash, amounts[i] is the balance of ids[i].
+   struct [[eosio::table]] coldledger {
+      uint64_t                last;
+      std::vector<uint64_t>   ids;
+      std::vector<int64_t>    amounts;
+
+      uint64_t    primary_key()const { return last; }
+
+      //a bijection, distinct IDs never share a hash
+      static uint64_t hash_of( uint64_t id ) {
+         id = (id ^ (id >> 30)) * 0xbf58476d1ce4e5b9ULL;
+         id = (id ^ (id >> 27)) * 0x94d049bb133111ebULL;
+         return id ^ (id >> 31);
+      }
+
+      size_t index_of( uint64_t id )const {
+         return size_t( std::lower_bound( ids.begin(), ids.end(), hash_of( id ),
+                                          []( uint64_t a, uint64_t h ) { return hash_of( a ) < h; } ) - ids.begin() );
+      }
+      bool        has( uint64_t id )const { size_t i = index_of( id ); return i < ids.size() && ids[i] == id; }
+      int64_t     amount_of( uint64_t id )const { return amounts[index_of( id )]; }
+
+      void insert( uint64_t id, int64_t amount ) {
+         size_t i = index_of( id );
+         ids.insert( ids.begin() + i, id );
+         amounts.insert( amounts.begin() + i, amount );
+      }
+
+      int64_t remove( uint64_t id ) {
+         size_t i = index_of( id );
+         int64_t amount = amounts[i];
+         ids.erase( ids.begin() + i );
+         amounts.erase( amounts.begin() + i );
+         return amount;
+      }
+
+      //Move the lower half of the ledgers to low, keyed by the highest hash it keeps
+      void split( coldledger& low ) {
+         size_t half = ids.size() / 2;
+         low.last = hash_of( ids[half - 1] );
+         low.ids.assign( ids.begin(), ids.begin() + half );
+         low.amounts.assign( amounts.begin(), amounts.begin() + half );
+         ids.erase( ids.begin(), ids.begin() + half );
+         amounts.erase( amounts.begin(), amounts.begin() + half );
+      }
+
+      EOSLIB_SERIALIZE( coldledger, (last)(ids)(amounts))
+   };
+
+   //The cold row that holds or would hold a ledger, end() if no row covers its hash
+   template<typename ColdTable>
+   inline auto cold_row_of( const ColdTable& cold, uint64_t id ) -> decltype( cold.end() ) {
+      return cold.lower_bound( coldledger::hash_of( id ) );
+   }
+
+   /**
+   * Take a ledger out of the cold tier, dropping its row once empty
+   *
+   * @return false if the ledger is not cold
+   **/
+   template<typename ColdTable>
+   inline bool take_cold( ColdTable& cold, uint64_t id, int64_t& amount ) {
+      auto it = cold_row_of( cold, id );
+      PROFILE_READS( 1 );
+      if( it == cold.end() || !it->has( id ) ) return false;
+      PROFILE_WRITES( 1 );
+      if( it->ids.size() == 1 ) {
+         amount = it->amounts[0];
+         cold.erase( *it );
+      } else {
+         cold.modify( it, 0, [&]( auto& c ) {
+            amount = c.remove( id );
+         });
+      }
+      return true;
+   }
+
+   //Put a ledger into its cold row, splitting the row once it is over cold_row_cap
+   template<typename ColdTable>
+   inline void put_cold( ColdTable& cold, account_name payer, uint64_t id, int64_t amount ) {
+      auto it = cold_row_of( cold, id );
+      PROFILE_READS( 1 );
+      PROFILE_WRITES( 1 );
+      if( it == cold.end() ) {
+         //above the highest row's key, so this row takes every hash up to ~0
+         cold.emplace( payer, [&]( auto& c ) {
+            c.last = ~uint64_t( 0 );
+            c.insert( id, amount );
+         });
+         return;
+      }
+
+      coldledger low;
+      cold.modify( it, 0, [&]( auto& c ) {
+         c.insert( id, amount );
+         if( c.ids.size() > cold_row_cap ) c.split( low );
+      });
+      if( !low.ids.empty() ) {
+         PROFILE_WRITES( 1 );
+         cold.emplace( payer, [&]( auto& c ) { c = low; });
+      }
+   }
+
+} /// namespace eosio
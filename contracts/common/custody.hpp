@@ -0,0 +1,69 @@
+/**
+ *  custody.hpp
+ *  copyright TAPx.io
+ *
+ *  Custody of ledger deposits, spread over a few stripes per symbol so
+ *  deposits and withdrawals of different ledgers write different rows
+ *  instead of the contract's own accounts balance.
+ */
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+
+#include "profile.hpp"
+
+namespace eosio {
+
+   static constexpr uint64_t custody_stripes = 16;
+
+   //Custody held on one stripe, scoped by the raw symbol. A stripe may go
+   //negative when a ledger withdraws what another stripe took in; only the
+   //sum over the stripes plus the contract's accounts balance is meaningful.
+   struct [[eosio::table]] custodystripe {
+      uint64_t    stripe;
+      int64_t     amount;
+
+      uint64_t    primary_key()const { return stripe; }
+      EOSLIB_SERIALIZE( custodystripe, (stripe)(amount))
+   };
+   typedef eosio::multi_index<N(custody), custodystripe> custodies;
+
+   //Stripe of a ledger. Name encoded IDs end in zero bits, so the stripe comes
+   //from the top bits of a multiplicative hash of the whole ID.
+   inline uint64_t custody_stripe_of( uint64_t lgid ) {
+      return (lgid * 0x9e3779b97f4a7c15ULL) >> 60;
+   }
+   static_assert( custody_stripes == 16, "custody_stripe_of takes 4 bits" );
+
+   /**
+   * Add custody of a symbol on one stripe, or take it with a negative amount
+   *
+   * @param code     contract account, also pays for a new stripe
+   * @param sym      raw symbol
+   * @param stripe   stripe number, below custody_stripes
+   * @param amount   custody change in the symbol's units
+   **/
+   inline void add_custody_stripe( account_name code, uint64_t sym, uint64_t stripe, int64_t amount ) {
+      PROFILE_SECTION( "add_custody" );
+      custodies stripes( code, sym );
+      auto it = stripes.find( stripe );
+      PROFILE_READS( 1 );
+      PROFILE_WRITES( 1 );
+      if( it == stripes.end() ) {
+         stripes.emplace( code, [&]( auto& s ) {
+            s.stripe = stripe;
+            s.amount = amount;
+         });
+      } else {
+         stripes.modify( it, 0, [&]( auto& s ) {
+            s.amount += amount;
+         });
+      }
+   }
+
+   //Add custody on the stripe of a ledger, or take it with a negative amount
+   inline void add_custody( account_name code, uint64_t sym, uint64_t lgid, int64_t amount ) {
+      add_custody_stripe( code, sym, custody_stripe_of( lgid ), amount );
+   }
+
+} /// namespace eosio
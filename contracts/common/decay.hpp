@@ -0,0 +1,52 @@
+/**
+ *  decay.hpp
+ *  copyright TAPx.io
+ *
+ *  Fixed-point exponential decay shared by the TAPx contracts.
+ */
+#pragma once
+
+#include <stdint.h>
+
+namespace eosio {
+
+   //half-life of reputation scores, in seconds
+   static constexpr uint32_t reputation_half_life = 30 * 24 * 3600;
+
+   /**
+   * Decay score by 2^(-elapsed/half_life)
+   *
+   * Whole half-lives are applied as shifts. The remainder uses a Q32 table
+   * of 2^(-k/16) with linear interpolation, which stays within 0.03% of the
+   * exact value.
+   *
+   * @param score      value to decay
+   * @param elapsed    seconds since score was last updated
+   * @param half_life  seconds for score to halve, must be positive
+   **/
+   inline uint64_t decay_score( uint64_t score, uint32_t elapsed, uint32_t half_life ) {
+      static constexpr uint64_t pow2_q32[17] = {
+         0x100000000ULL, 0xf5257d15ULL, 0xeac0c6e8ULL, 0xe0ccdeecULL, 0xd744fccbULL, 0xce248c15ULL,
+         0xc5672a11ULL,  0xbd08a39fULL, 0xb504f334ULL, 0xad583eeaULL, 0xa5fed6aaULL, 0x9ef53261ULL,
+         0x9837f052ULL,  0x91c3d374ULL, 0x8b95c1e4ULL, 0x85aac368ULL, 0x80000000ULL
+      };
+
+      uint32_t halvings = elapsed / half_life;
+      if( halvings >= 64 ) return 0;
+      score >>= halvings;
+
+      //fraction of a half-life left over, Q32
+      uint64_t frac = (uint64_t(elapsed % half_life) << 32) / half_life;
+      uint32_t k    = uint32_t(frac >> 28);
+      uint64_t t    = frac & ((1ULL << 28) - 1);
+      uint64_t factor = pow2_q32[k] - (((pow2_q32[k] - pow2_q32[k + 1]) * t) >> 28);
+
+      return uint64_t( (unsigned __int128)score * factor >> 32 );
+   }
+
+   //saturating add for accumulated scores
+   inline uint64_t add_score( uint64_t score, uint64_t points ) {
+      return score > UINT64_MAX - points ? UINT64_MAX : score + points;
+   }
+
+} /// namespace eosio
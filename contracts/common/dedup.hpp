@@ -0,0 +1,69 @@
+/**
+ *  dedup.hpp
+ *  copyright TAPx.io
+ *
+ *  Expiring record of client operation ids, so a relayer can resubmit
+ *  ledger operations whose transaction fate is unknown without paying twice.
+ */
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+
+#include "profile.hpp"
+
+namespace eosio {
+
+   //how long an operation id is remembered, longer than the 1 hour maximum
+   //transaction expiration so every resubmission of one operation is covered
+   static constexpr uint32_t ledger_op_window = 2 * 3600;
+   //expired ids pruned per recorded operation, more than one so the table shrinks
+   static constexpr uint32_t ledger_op_prune_batch = 2;
+
+   //Applied operation id, scope is the contract itself
+   struct [[eosio::table]] ledgerop {
+      uint64_t    id;
+      uint32_t    expires;
+
+      uint64_t    primary_key()const { return id; }
+      uint64_t    by_expires()const { return expires; }
+      EOSLIB_SERIALIZE( ledgerop, (id)(expires))
+   };
+   typedef eosio::multi_index<N(ledgerops), ledgerop,
+      indexed_by<N(byexpires), const_mem_fun<ledgerop, uint64_t, &ledgerop::by_expires>>
+   > ledgerops;
+
+   /**
+   * Record a client operation id, pruning a few expired ones
+   *
+   * @param code  contract account, also pays for the record
+   * @param opid  client operation id, 0 to opt out of deduplication
+   * @return false if the id was already applied within the window and the
+   *         operation must be skipped
+   **/
+   inline bool claim_ledger_op( account_name code, uint64_t opid ) {
+      if( opid == 0 ) return true;
+
+      PROFILE_SECTION( "claim_ledger_op" );
+      ledgerops ops( code, code );
+      PROFILE_READS( 1 );
+      if( ops.find( opid ) != ops.end() ) return false;
+
+      uint32_t t = now();
+      auto idx = ops.get_index<N(byexpires)>();
+      PROFILE_READS( 1 );
+      auto it = idx.begin();
+      for( uint32_t n = 0; n < ledger_op_prune_batch && it != idx.end() && it->expires <= t; ++n ) {
+         PROFILE_READS( 1 );
+         PROFILE_WRITES( 1 );
+         it = idx.erase( it );
+      }
+
+      PROFILE_WRITES( 1 );
+      ops.emplace( code, [&]( auto& o ) {
+         o.id = opid;
+         o.expires = t + ledger_op_window;
+      });
+      return true;
+   }
+
+} /// namespace eosio
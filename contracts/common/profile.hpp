@@ -0,0 +1,102 @@
+/**
+ *  profile.hpp
+ *  copyright TAPx.io
+ *
+ *  Opt-in instrumentation of the contracts' hot paths, built with
+ *  -DTAPX_PROFILE and compiled to nothing otherwise.
+ *
+ *  PROFILE_SECTION opens a scoped section. The PROFILE_READS/WRITES/SENDS/
+ *  NOTIFIES counters add to the innermost open section, and each section
+ *  prints its own counts to the console when it closes:
+ *
+ *    PROF transfer;move_balance;sub_balance 1 1 0 0
+ *
+ *  path, db reads, db writes, inline sends, notifications. Contract code
+ *  cannot time itself, current_time() is the block time for the whole
+ *  action, so sections count the operations that dominate an action's cost
+ *  instead; tools/proffold folds the lines of a nodeos console log into a
+ *  per-section report and flame graph input.
+ */
+#pragma once
+
+#ifdef TAPX_PROFILE
+
+#include <stdint.h>
+
+extern "C" {
+   __attribute__((eosio_wasm_import))
+   void prints_l( const char* cstr, uint32_t len );
+   __attribute__((eosio_wasm_import))
+   void printui( uint64_t value );
+}
+
+namespace eosio { namespace profile {
+
+   enum counter {
+      db_reads = 0,
+      db_writes,
+      inline_sends,
+      notifications,
+      counter_count
+   };
+
+   struct section {
+      const char*    label;
+      section*       parent;
+      uint32_t       counts[counter_count] = {};
+
+      //innermost open section, the wasm instance is fresh for every action
+      static section*& current() {
+         static section* open = nullptr;
+         return open;
+      }
+
+      explicit section( const char* l ) : label( l ), parent( current() ) {
+         current() = this;
+      }
+
+      ~section() {
+         current() = parent;
+         ::prints_l( "PROF ", 5 );
+         print_path( this );
+         for( uint32_t c = 0; c < counter_count; ++c ) {
+            ::prints_l( " ", 1 );
+            ::printui( counts[c] );
+         }
+         ::prints_l( "\n", 1 );
+      }
+
+      static void print_path( const section* s ) {
+         if( s->parent ) {
+            print_path( s->parent );
+            ::prints_l( ";", 1 );
+         }
+         uint32_t len = 0;
+         while( s->label[len] ) ++len;
+         ::prints_l( s->label, len );
+      }
+   };
+
+   inline void count( counter c, uint32_t n ) {
+      if( section* s = section::current() ) s->counts[c] += n;
+   }
+
+} } /// namespace eosio::profile
+
+#define PROFILE_CONCAT_( a, b ) a##b
+#define PROFILE_CONCAT( a, b ) PROFILE_CONCAT_( a, b )
+#define PROFILE_SECTION( label ) ::eosio::profile::section PROFILE_CONCAT( profile_section_, __LINE__ )( label )
+#define PROFILE_READS( n )     ::eosio::profile::count( ::eosio::profile::db_reads, n )
+#define PROFILE_WRITES( n )    ::eosio::profile::count( ::eosio::profile::db_writes, n )
+#define PROFILE_SENDS( n )     ::eosio::profile::count( ::eosio::profile::inline_sends, n )
+#define PROFILE_NOTIFIES( n )  ::eosio::profile::count( ::eosio::profile::notifications, n )
+
+#else
+
+#define PROFILE_SECTION( label )
+#define PROFILE_READS( n )
+#define PROFILE_WRITES( n )
+#define PROFILE_SENDS( n )
+#define PROFILE_NOTIFIES( n )
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ *  query.hpp
+ *  copyright TAPx.io
+ *
+ *  Support for read-only batch query actions that answer through the
+ *  action return value instead of table reads by the client.
+ */
+#pragma once
+
+#include <eosiolib/datastream.hpp>
+#include <eosiolib/eosio.hpp>
+
+extern "C" {
+   //host function of the ACTION_RETURN_VALUE protocol feature
+   __attribute__((eosio_wasm_import))
+   void set_action_return_value( void* data, size_t size );
+}
+
+namespace eosio {
+
+   //most keys one query action accepts, keeps it well inside the cpu limit
+   static constexpr size_t max_query_keys = 256;
+
+   template<typename T>
+   inline void return_value( const T& value ) {
+      auto data = pack( value );
+      ::set_action_return_value( data.data(), data.size() );
+   }
+
+} /// namespace eosio
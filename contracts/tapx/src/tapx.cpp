@@ -9,17 +9,23 @@ namespace eosio {
 
 void tapx::create( account_name issuer, asset maximum_supply )
 {
+    PROFILE_SECTION( "create" );
     require_auth( _self );
 
     auto sym = maximum_supply.symbol;
     eosio_assert( sym.is_valid(), "invalid symbol name" );
     eosio_assert( maximum_supply.is_valid(), "invalid supply");
     eosio_assert( maximum_supply.amount > 0, "max-supply must be positive");
+#ifdef TAPX_SINGLE_SYMBOL
+    eosio_assert( sym == symbol_type(tapx_symbol), "contract is built for a single symbol" );
+#endif
 
     stats statstable( _self, sym.name() );
     auto existing = statstable.find( sym.name() );
+    PROFILE_READS( 1 );
     eosio_assert( existing == statstable.end(), "token with symbol already exists" );
 
+    PROFILE_WRITES( 1 );
     statstable.emplace( _self, [&]( auto& s ) {
        s.supply.symbol = maximum_supply.symbol;
        s.max_supply    = maximum_supply;
@@ -30,6 +36,7 @@ void tapx::create( account_name issuer, asset maximum_supply )
 
 void tapx::issue(account_name to, asset quantity, string memo )
 {
+    PROFILE_SECTION( "issue" );
     auto sym = quantity.symbol;
     eosio_assert( sym.is_valid(), "invalid symbol name" );
     eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
@@ -37,6 +44,7 @@ void tapx::issue(account_name to, asset quantity, string memo )
     auto sym_name = sym.name();
     stats statstable( _self, sym_name );
     auto existing = statstable.find( sym_name );
+    PROFILE_READS( 1 );
     eosio_assert( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
     const auto& st = *existing;
 
@@ -47,6 +55,7 @@ void tapx::issue(account_name to, asset quantity, string memo )
     eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
     eosio_assert( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
 
+    PROFILE_WRITES( 1 );
     statstable.modify( st, 0, [&]( auto& s ) {
        s.supply += quantity;
     });
@@ -54,12 +63,14 @@ void tapx::issue(account_name to, asset quantity, string memo )
     add_balance( st.issuer, quantity, st.issuer );
 
     if( to != st.issuer ) {
+       PROFILE_SENDS( 1 );
        SEND_INLINE_ACTION( *this, transfer, {st.issuer,N(active)}, {st.issuer, to, quantity, memo} );
     }
 }
 
 void tapx::retire( asset quantity, string memo )
 {
+    PROFILE_SECTION( "retire" );
     auto sym = quantity.symbol;
     eosio_assert( sym.is_valid(), "invalid symbol name" );
     eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
@@ -67,6 +78,7 @@ void tapx::retire( asset quantity, string memo )
     auto sym_name = sym.name();
     stats statstable( _self, sym_name );
     auto existing = statstable.find( sym_name );
+    PROFILE_READS( 1 );
     eosio_assert( existing != statstable.end(), "token with symbol does not exist" );
     const auto& st = *existing;
 
@@ -76,6 +88,7 @@ void tapx::retire( asset quantity, string memo )
 
     eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
 
+    PROFILE_WRITES( 1 );
     statstable.modify( st, 0, [&]( auto& s ) {
        s.supply -= quantity;
     });
@@ -88,19 +101,26 @@ void tapx::transfer( account_name from,
                     asset        quantity,
                     string       memo )
 {
+    PROFILE_SECTION( "transfer" );
+    move_balance( from, to, quantity, memo );
+    record_activity( _self, quantity.symbol.name(), activity_transfer, quantity.amount, from );
+}
+
+//transfer body shared with the ledger deposit/withdraw paths, which record their own activity
+void tapx::move_balance( account_name from, account_name to, asset quantity, string memo )
+{
+    PROFILE_SECTION( "move_balance" );
     eosio_assert( from != to, "cannot transfer to self" );
     require_auth( from );
     eosio_assert( is_account( to ), "to account does not exist");
-    auto sym = quantity.symbol.name();
-    stats statstable( _self, sym );
-    const auto& st = statstable.get( sym );
+    check_symbol( quantity );
 
     require_recipient( from );
     require_recipient( to );
+    PROFILE_NOTIFIES( 2 );
 
     eosio_assert( quantity.is_valid(), "invalid quantity" );
     eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
-    eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
     eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
 
     auto payer = has_auth( to ) ? to : from;
@@ -109,12 +129,58 @@ void tapx::transfer( account_name from,
     add_balance( to, quantity, payer );
 }
 
+void tapx::check_symbol( const asset& quantity )const
+{
+#ifdef TAPX_SINGLE_SYMBOL
+    //create only accepts tapx_symbol in this build, so no other stat row can exist
+    eosio_assert( quantity.symbol == symbol_type(tapx_symbol), "symbol precision mismatch" );
+#else
+    auto sym = quantity.symbol.name();
+    stats statstable( _self, sym );
+    const auto& st = statstable.get( sym );
+    PROFILE_READS( 1 );
+    eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+#endif
+}
+
+//Move tokens from an EOS account into ledger custody, without touching this contract's own balance row
+void tapx::deposit_custody( account_name from, uint64_t lgid, asset quantity )
+{
+    PROFILE_SECTION( "deposit_custody" );
+    eosio_assert( quantity.is_valid(), "invalid quantity" );
+    eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
+    check_symbol( quantity );
+    require_recipient( from );
+    PROFILE_NOTIFIES( 1 );
+
+    sub_balance( from, quantity );
+    add_custody( _self, quantity.symbol, lgid, quantity.amount );
+}
+
+//Pay tokens out of ledger custody to an EOS account
+void tapx::withdraw_custody( uint64_t lgid, account_name to, asset quantity )
+{
+    PROFILE_SECTION( "withdraw_custody" );
+    eosio_assert( to != _self, "cannot withdraw to self" );
+    eosio_assert( is_account( to ), "to account does not exist");
+    eosio_assert( quantity.is_valid(), "invalid quantity" );
+    eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
+    require_recipient( to );
+    PROFILE_NOTIFIES( 1 );
+
+    add_custody( _self, quantity.symbol, lgid, -quantity.amount );
+    add_balance( to, quantity, _self );
+}
+
 void tapx::sub_balance( account_name owner, asset value ) {
+   PROFILE_SECTION( "sub_balance" );
    accounts from_acnts( _self, owner );
 
    const auto& from = from_acnts.get( value.symbol.name(), "no balance object found" );
    eosio_assert( from.balance.amount >= value.amount, "overdrawn balance" );
 
+   PROFILE_READS( 1 );
+   PROFILE_WRITES( 1 );
    from_acnts.modify( from, owner, [&]( auto& a ) {
          a.balance -= value;
       });
@@ -122,8 +188,11 @@ void tapx::sub_balance( account_name owner, asset value ) {
 
 void tapx::add_balance( account_name owner, asset value, account_name ram_payer )
 {
+   PROFILE_SECTION( "add_balance" );
    accounts to_acnts( _self, owner );
    auto to = to_acnts.find( value.symbol.name() );
+   PROFILE_READS( 1 );
+   PROFILE_WRITES( 1 );
    if( to == to_acnts.end() ) {
       to_acnts.emplace( ram_payer, [&]( auto& a ){
         a.balance = value;
@@ -137,10 +206,13 @@ void tapx::add_balance( account_name owner, asset value, account_name ram_payer
 
 void tapx::open( account_name owner, symbol_type symbol, account_name ram_payer )
 {
+   PROFILE_SECTION( "open" );
    require_auth( ram_payer );
    accounts acnts( _self, owner );
    auto it = acnts.find( symbol.name() );
+   PROFILE_READS( 1 );
    if( it == acnts.end() ) {
+      PROFILE_WRITES( 1 );
       acnts.emplace( ram_payer, [&]( auto& a ){
         a.balance = asset{0, symbol};
       });
@@ -148,27 +220,98 @@ void tapx::open( account_name owner, symbol_type symbol, account_name ram_payer
 }
 
 void tapx::close( account_name owner, symbol_type symbol ) {
+   PROFILE_SECTION( "close" );
    accounts acnts( _self, owner );
    auto it = acnts.find( symbol.name() );
+   PROFILE_READS( 1 );
+   PROFILE_WRITES( 1 );
    eosio_assert( it != acnts.end(), "Balance row already deleted or never existed. Action won't have any effect." );
    eosio_assert( it->balance.amount == 0, "Cannot close because the balance is not zero." );
-   acnts.erase( it );
+   acnts.erase( *it );
+}
+
+tapx::tapledgers::const_iterator tapx::find_ledger( tapledgers& ledgers, account_name ledger_id ) {
+  PROFILE_SECTION( "find_ledger" );
+  auto it = ledgers.find( ledger_id );
+  PROFILE_READS( 1 );
+  if( it != ledgers.end() ) return it;
+
+  //Dormant, promote it back to a hot row
+  tapcolds cold( _self, tapx_symbol );
+  int64_t amount;
+  if( take_cold( cold, ledger_id, amount ) ) {
+    PROFILE_WRITES( 1 );
+    return ledgers.emplace( _self, [&]( auto& a ){
+      a.ledger_id = ledger_id;
+      a.amount = amount;
+    });
+  }
+
+  //Not migrated yet, move the legacy row over on first touch
+  tapbalances ttbls( _self, symbol_type(tapx_symbol).name() );
+  auto legacy = ttbls.find( ledger_id );
+  PROFILE_READS( 1 );
+  if( legacy == ttbls.end() ) return it;
+
+  PROFILE_WRITES( 2 );
+  it = ledgers.emplace( _self, [&]( auto& a ){
+    a.ledger_id = ledger_id;
+    a.amount = legacy->balance.amount;
+  });
+  ttbls.erase( *legacy );
+  return it;
+}
+
+void tapx::sub_ledger( account_name ledger_id, asset value ) {
+  PROFILE_SECTION( "sub_ledger" );
+  eosio_assert( value.symbol == symbol_type(tapx_symbol), "symbol precision mismatch" );
+
+  tapledgers ledgers( _self, tapx_symbol );
+  auto from = find_ledger( ledgers, ledger_id );
+  eosio_assert( from != ledgers.end(), "ledger ID doesn't exist" );
+  eosio_assert( from->amount >= value.amount, "overdrawn balance" );
+
+  PROFILE_WRITES( 1 );
+  ledgers.modify( from, 0, [&]( auto& a ) {
+    a.amount -= value.amount;
+  });
+}
+
+void tapx::add_ledger( account_name ledger_id, asset value, account_name ram_payer ) {
+  PROFILE_SECTION( "add_ledger" );
+  eosio_assert( value.symbol == symbol_type(tapx_symbol), "symbol precision mismatch" );
+
+  tapledgers ledgers( _self, tapx_symbol );
+  auto to = find_ledger( ledgers, ledger_id );
+
+  PROFILE_WRITES( 1 );
+  if( to == ledgers.end() ) {
+    //First credit opens the ledger, billed to the account that authorized the credit
+    ledgers.emplace( ram_payer, [&]( auto& a ){
+      a.ledger_id = ledger_id;
+      a.amount = value.amount;
+    });
+    return;
+  }
+  ledgers.modify( to, 0, [&]( auto& a ) {
+    a.amount += value.amount;
+  });
 }
 
 void tapx::createlgid(account_name ledger_id) {
+  PROFILE_SECTION( "createlgid" );
   require_auth( _self );
-  
-  asset TAPxAsset = asset(0, S(4, TAP));
 
-  //Search for tap balance table for ledger account existing 
-  tapbalances ttbls( _self, TAPxAsset.symbol.name() );
+  //Search for tap ledger for ledger account existing 
+  tapledgers ledgers( _self, tapx_symbol );
 
-  auto newledgerid = ttbls.find( ledger_id );
-  if( newledgerid == ttbls.end() ) {
+  auto newledgerid = find_ledger( ledgers, ledger_id );
+  if( newledgerid == ledgers.end() ) {
     //If account does not existing, create new ledger account
-    ttbls.emplace( _self, [&]( auto& a ){
-      a.balance = TAPxAsset;
+    PROFILE_WRITES( 1 );
+    ledgers.emplace( _self, [&]( auto& a ){
       a.ledger_id = ledger_id;
+      a.amount = 0;
     });
   } else {
     //Assertion. Trying to create redundant ledger account
@@ -176,116 +319,265 @@ void tapx::createlgid(account_name ledger_id) {
   }
 }
 
-void tapx::depledger(account_name tapx_from, account_name ledger_to , asset quantity) {
-  require_auth( tapx_from );
-  
-  asset TAPxAsset = asset(0, S(4, TAP));
-  eosio_assert( quantity.symbol == TAPxAsset.symbol, "symbol precision mismatch" );
+void tapx::migrate(uint32_t max_rows) {
+  PROFILE_SECTION( "migrate" );
+  require_auth( _self );
 
-  //Search for tap balance table for ledger account existing 
-  tapbalances ttbls( _self, TAPxAsset.symbol.name() );
+  tapbalances ttbls( _self, symbol_type(tapx_symbol).name() );
+  tapledgers ledgers( _self, tapx_symbol );
+
+  PROFILE_READS( 1 );
+  auto legacy = ttbls.begin();
+  for( uint32_t n = 0; n < max_rows && legacy != ttbls.end(); ++n ) {
+    PROFILE_READS( 1 );
+    PROFILE_WRITES( 2 );
+    ledgers.emplace( _self, [&]( auto& a ){
+      a.ledger_id = legacy->ledger_id;
+      a.amount = legacy->balance.amount;
+    });
+    legacy = ttbls.erase( legacy );
+  }
+}
 
-  auto depositledgerid = ttbls.find( ledger_to );
-  if( depositledgerid == ttbls.end() ) {
-    //Assertion. Trying to deposit to a non-existing ledger account
-    eosio_assert( false, "ledger ID doesn't exist" );
-  } else {
-    //Transfer tapx to self contract as deposit
-    transfer(tapx_from, _self, quantity, "deposit tapx");
+void tapx::getbalances( vector<account_name> owners, vector<account_name> ledger_ids ) {
+  PROFILE_SECTION( "getbalances" );
+  eosio_assert( owners.size() + ledger_ids.size() <= max_query_keys, "too many keys" );
+  const symbol_type sym = symbol_type(tapx_symbol);
+
+  balance_page page;
+  page.accounts.reserve( owners.size() );
+  for( auto owner : owners ) {
+    accounts acnts( _self, owner );
+    auto it = acnts.find( sym.name() );
+    PROFILE_READS( 1 );
+    page.accounts.push_back( it == acnts.end() ? asset{0, sym} : it->balance );
+  }
 
-    //Update the deposit on tap balance table
-    ttbls.modify( depositledgerid, 0, [&]( auto& a ) {
-      a.balance += quantity;
-    });
+  //Read cold and legacy rows in place, a query never promotes or migrates
+  tapledgers ledgers( _self, tapx_symbol );
+  tapcolds cold( _self, tapx_symbol );
+  tapbalances ttbls( _self, sym.name() );
+  page.ledgers.reserve( ledger_ids.size() );
+  page.reputations.reserve( ledger_ids.size() );
+  for( auto ledger_id : ledger_ids ) {
+    asset balance{0, sym};
+    auto it = ledgers.find( ledger_id );
+    auto row = it == ledgers.end() ? cold_row_of( cold, ledger_id ) : cold.end();
+    PROFILE_READS( it == ledgers.end() ? 2 : 1 );
+    if( it != ledgers.end() ) {
+      balance.amount = it->amount;
+    } else if( row != cold.end() && row->has( ledger_id ) ) {
+      balance.amount = row->amount_of( ledger_id );
+    } else {
+      auto legacy = ttbls.find( ledger_id );
+      PROFILE_READS( 1 );
+      if( legacy != ttbls.end() ) balance.amount = legacy->balance.amount;
+    }
+    page.ledgers.push_back( balance );
+    PROFILE_READS( 1 );
+    page.reputations.push_back( get_reputation( ledger_id, sym.name() ) );
   }
+
+  return_value( page );
 }
 
-void tapx::wdrledger(account_name ledger_from, account_name tapx_to, asset quantity) {
+void tapx::demote( vector<account_name> ledger_ids ) {
+  PROFILE_SECTION( "demote" );
   require_auth( _self );
+  eosio_assert( ledger_ids.size() <= cold_demote_batch, "too many ledger IDs" );
+
+  tapledgers ledgers( _self, tapx_symbol );
+  tapcolds cold( _self, tapx_symbol );
+  for( auto ledger_id : ledger_ids ) {
+    auto it = ledgers.find( ledger_id );
+    PROFILE_READS( 1 );
+    if( it == ledgers.end() ) continue;
+
+    put_cold( cold, _self, ledger_id, it->amount );
+    PROFILE_WRITES( 1 );
+    ledgers.erase( *it );
+  }
+}
 
-  asset TAPxAsset = asset(0, S(4, TAP));
-  eosio_assert( quantity.symbol == TAPxAsset.symbol, "symbol precision mismatch" );
+void tapx::depledger(account_name tapx_from, account_name ledger_to , asset quantity) {
+  PROFILE_SECTION( "depledger" );
+  require_auth( tapx_from );
 
-  //Search for tap balance table for ledger ID account existing 
-  tapbalances ttbls( _self, TAPxAsset.symbol.name() );
+  //Take tapx into ledger custody as deposit
+  deposit_custody( tapx_from, ledger_to, quantity );
 
-  auto withdrawledgerid = ttbls.find( ledger_from );
-  if( withdrawledgerid == ttbls.end() ) {
-    //Assertion. Trying to withdraw from a non-existing ledger ID account
-    eosio_assert( false, "ledger ID doesn't exist" );
-  } else {
-    //Update the withdraw on tap balance table
-    ttbls.modify( withdrawledgerid, 0, [&]( auto& a ) {
-      eosio_assert( a.balance.amount >= quantity.amount, "overdrawn balance" );
-      a.balance -= quantity;
-    });
+  //Update the deposit on tap ledger
+  add_ledger( ledger_to, quantity, tapx_from );
 
-    //Transfer tapx from self contract to tap_to EOS account
-    transfer(_self, tapx_to, quantity, "withdraw tapx");
-  }
+  record_activity( _self, quantity.symbol.name(), activity_ledger, quantity.amount, tapx_from );
 }
 
-void tapx::trfledger( account_name ledger_from, account_name ledger_to, asset quantity) {
+void tapx::wdrledger(account_name ledger_from, account_name tapx_to, asset quantity, uint64_t opid) {
+  PROFILE_SECTION( "wdrledger" );
   require_auth( _self );
+  if( !claim_ledger_op( _self, opid ) ) return;
 
-  asset TAPxAsset = asset(0, S(4, TAP));
-  eosio_assert( quantity.symbol == TAPxAsset.symbol, "symbol precision mismatch" );
+  //Update the withdraw on tap ledger
+  sub_ledger( ledger_from, quantity );
 
-  //Search for tap balance table for ledger ID account existing 
-  tapbalances ttbls( _self, TAPxAsset.symbol.name() );
+  //Pay tapx out of ledger custody to tap_to EOS account
+  withdraw_custody( ledger_from, tapx_to, quantity );
 
-  auto subledgerid = ttbls.find( ledger_from );
-  if( subledgerid == ttbls.end() ) {
-    //Assertion. Trying to sub from a non-existing ledger ID account
-    eosio_assert( false, "ledger from ID doesn't exist" );
-  } else {
-    //Search for tap balance table for ledger to account existing 
-    auto addledgerid = ttbls.find( ledger_to );
-    if( addledgerid == ttbls.end() ) {
-      //Assertion. Trying to deposit to a non-existing ledger to account
-      eosio_assert( false, "ledger to account doesn't exist" );
-    } else {
-      //Sub from subledgerid on tap balance table
-      ttbls.modify( subledgerid, 0, [&]( auto& a ) {
-        eosio_assert( a.balance.amount >= quantity.amount, "overdrawn balance" );
-        a.balance -= quantity;
-      });
+  record_activity( _self, quantity.symbol.name(), activity_ledger, quantity.amount, ledger_from );
+}
+
+void tapx::trfledger( account_name ledger_from, account_name ledger_to, asset quantity, uint64_t opid) {
+  PROFILE_SECTION( "trfledger" );
+  require_auth( _self );
+  eosio_assert( ledger_from != ledger_to, "cannot transfer to self" );
+  eosio_assert( quantity.is_valid(), "invalid quantity" );
+  eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
+  if( !claim_ledger_op( _self, opid ) ) return;
 
-      //Then add the balance
-      ttbls.modify( addledgerid, 0, [&]( auto& a ) {
-        a.balance += quantity;
+  //Sub from ledger_from, then add to ledger_to
+  sub_ledger( ledger_from, quantity );
+  add_ledger( ledger_to, quantity, _self );
+
+  //Tips received build the recipient's reputation
+  add_reputation( quantity.symbol.name(), ledger_to, quantity.amount );
+
+  record_activity( _self, quantity.symbol.name(), activity_ledger, quantity.amount, ledger_from );
+}
+
+void tapx::regbrand( symbol_type symbolo, account_name contract, account_name staker ) {
+    PROFILE_SECTION( "regbrand" );
+    require_auth( _self );
+    eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+    eosio_assert( is_account( contract ), "brand token contract account does not exist" );
+    eosio_assert( is_account( staker ), "brand token user account does not exist" );
+
+    brandregs regtbl( _self, _self );
+    auto existing = regtbl.find( symbolo.name() );
+    PROFILE_READS( 1 );
+    PROFILE_WRITES( 1 );
+    if( existing == regtbl.end() ) {
+      //A brand staked before the registry existed has its TAPx here already, seed
+      //staked from the max supply it backs (create starts max supply at one unit)
+      stats brandstats( contract, symbolo.name() );
+      PROFILE_READS( 1 );
+      auto st = brandstats.find( symbolo.name() );
+      int64_t staked = 0;
+      if( st != brandstats.end() ) {
+        eosio_assert( st->max_supply.symbol == symbolo, "symbol precision mismatch" );
+        eosio_assert( (st->max_supply.amount - 1) % stake_rate == 0, "brand max supply is not backed by whole TAPx units" );
+        staked = (st->max_supply.amount - 1) / stake_rate;
+      }
+      regtbl.emplace( _self, [&]( auto& r ) {
+        r.symbol   = symbolo;
+        r.contract = contract;
+        r.staker   = staker;
+        r.staked   = asset(staked, tapx_symbol);
+      });
+    } else {
+      //Moving a brand to another contract keeps its staked TAPx
+      eosio_assert( existing->symbol == symbolo, "symbol precision mismatch" );
+      regtbl.modify( existing, 0, [&]( auto& r ) {
+        r.contract = contract;
+        r.staker   = staker;
       });
     }
+}
+
+void tapx::add_reputation( symbol_name sym, account_name ledger_id, uint64_t points ) {
+  PROFILE_SECTION( "add_reputation" );
+  reputations reptable( _self, sym );
+  auto rep = reptable.find( ledger_id );
+  PROFILE_READS( 1 );
+  PROFILE_WRITES( 1 );
+  uint32_t t = now();
+  if( rep == reptable.end() ) {
+    reptable.emplace( _self, [&]( auto& r ){
+      r.ledger_id = ledger_id;
+      r.score = points;
+      r.updated = t;
+    });
+  } else {
+    //Apply the decay owed since the last update, then accumulate
+    reptable.modify( rep, 0, [&]( auto& r ) {
+      r.score = add_score( decay_score( r.score, t - r.updated, reputation_half_life ), points );
+      r.updated = t;
+    });
   }
 }
 
 //create brand token by TAPx
 void tapx::stake(account_name account, asset quantity, symbol_type symbolo) {
+    PROFILE_SECTION( "stake" );
     require_auth( account );
-    //brand token user account
-    eosio_assert( is_account( account ), "brand token user account does not exist" );
     eosio_assert( symbolo.is_valid(), "invalid symbol name" );
-    //transfer TAPx to this contract
-    trf_tapx(account,_self, quantity, "stake" );
+    eosio_assert( quantity.is_valid(), "invalid quantity" );
+    eosio_assert( quantity.amount > 0, "must stake positive quantity" );
+    eosio_assert( quantity.symbol == symbol_type(tapx_symbol), "symbol precision mismatch" );
+
+    //route by brand symbol to the contract hosting it
+    brandregs regtbl( _self, _self );
+    const auto& reg = regtbl.get( symbolo.name(), "brand is not registered" );
+    PROFILE_READS( 1 );
+    eosio_assert( reg.symbol == symbolo, "symbol precision mismatch" );
+    eosio_assert( reg.staker == account, "account is not the staker of this brand" );
+
+    //brand token supply at the exchange rate, checked before it can overflow
+    uint128_t brandamount = uint128_t(quantity.amount) * stake_rate;
+    eosio_assert( brandamount <= uint128_t(asset::max_amount), "stake exceeds brand token max amount" );
+
+    //move TAPx to this contract directly instead of an inline transfer
+    sub_balance( account, quantity );
+    add_balance( _self, quantity, _self );
+    require_recipient( account );
+    PROFILE_NOTIFIES( 1 );
+
+    PROFILE_WRITES( 1 );
+    regtbl.modify( reg, 0, [&]( auto& r ) {
+      r.staked += quantity;
+    });
     //increate the support of brand token
-    asset newquantitybt = asset{quantity.amount * 10,symbolo};
-    add_supply(account,newquantitybt,"stake" );
+    add_supply(reg.contract, asset{int64_t(brandamount), symbolo}, "stake" );
+
+    record_activity( _self, quantity.symbol.name(), activity_stake, quantity.amount, account );
 }
 
 //exchange to TAPx with brand token
 void tapx::unstake(account_name account, asset quantity, symbol_type symbolo) {
+    PROFILE_SECTION( "unstake" );
     require_auth( account );
-    //brand token user account
-    eosio_assert( is_account( account ), "brand token user account does not exist" );
-    eosio_assert( symbolo.is_valid(), "invalid symbol name" );
+    eosio_assert( quantity.is_valid(), "invalid quantity" );
+    eosio_assert( quantity.amount > 0, "must unstake positive quantity" );
+    eosio_assert( symbolo == symbol_type(tapx_symbol), "symbol precision mismatch" );
+    //no brand token dust may be burnt without TAPx in return
+    eosio_assert( quantity.amount % stake_rate == 0, "unstake quantity must be a multiple of the exchange rate" );
+
+    //route by brand symbol to the contract hosting it
+    brandregs regtbl( _self, _self );
+    const auto& reg = regtbl.get( quantity.symbol.name(), "brand is not registered" );
+    PROFILE_READS( 1 );
+    eosio_assert( reg.symbol == quantity.symbol, "symbol precision mismatch" );
+    eosio_assert( reg.staker == account, "account is not the staker of this brand" );
+
+    asset tapquantity = asset{quantity.amount / stake_rate, symbolo};
+    eosio_assert( reg.staked.amount >= tapquantity.amount, "unstake exceeds staked TAPx" );
+
     //unstake the support of brand token
-    sub_supply(account,quantity,"unstake" );
-    //transfer TAPx to user's address
-    asset newquantitybt = asset{quantity.amount / 10,symbolo};
-    trf_tapx(_self,account, newquantitybt, "unstake" );
+    sub_supply(reg.contract,quantity,"unstake" );
+    PROFILE_WRITES( 1 );
+    regtbl.modify( reg, 0, [&]( auto& r ) {
+      r.staked -= tapquantity;
+    });
+
+    //move TAPx back to the user directly instead of an inline transfer
+    sub_balance( _self, tapquantity );
+    add_balance( account, tapquantity, account );
+    require_recipient( account );
+    PROFILE_NOTIFIES( 1 );
+
+    record_activity( _self, tapquantity.symbol.name(), activity_unstake, tapquantity.amount, account );
 }
 
 
 } /// namespace eosio
 
-EOSIO_ABI( eosio::tapx, (create)(issue)(transfer)(open)(close)(retire)(depledger)(wdrledger)(trfledger)(stake)(unstake)(createlgid))
+EOSIO_ABI( eosio::tapx, (create)(issue)(transfer)(open)(close)(retire)(depledger)(wdrledger)(trfledger)(stake)(unstake)(regbrand)(createlgid)(migrate)(getbalances)(demote))
@@ -5,7 +5,16 @@
 #include <eosiolib/asset.hpp>
 #include <eosiolib/eosio.hpp>
 
+#include "../../common/activity.hpp"
+#include "../../common/coldtier.hpp"
+#include "../../common/custody.hpp"
+#include "../../common/decay.hpp"
+#include "../../common/dedup.hpp"
+#include "../../common/profile.hpp"
+#include "../../common/query.hpp"
+
 #include <string>
+#include <vector>
 
 namespace eosiosystem {
    class system_contract;
@@ -14,11 +23,36 @@ namespace eosiosystem {
 namespace eosio {
 
    using std::string;
+   using std::vector;
 
    class tapx : public contract {
       public:
+         /**
+         * Return value of getbalances, in key order, zero for missing rows.
+         * reputations holds each ledger's tipping reputation, decayed to now.
+         **/
+         struct balance_page {
+            vector<asset>      accounts;
+            vector<asset>      ledgers;
+            vector<uint64_t>   reputations;
+
+            EOSLIB_SERIALIZE( balance_page, (accounts)(ledgers)(reputations))
+         };
+
          tapx( account_name self ):contract(self){}
 
+         /**
+         * TAPx token symbol, also the symbol of every ledger balance.
+         * Building with -DTAPX_SINGLE_SYMBOL restricts the contract to this
+         * symbol so transfer checks precision without reading the stat table.
+         **/
+         static constexpr uint64_t tapx_symbol = S(4, TAP);
+
+         /**
+         * Brand token units minted per staked TAPx unit
+         **/
+         static constexpr int64_t stake_rate = 10;
+
          /**
          * Standard token contract - create
          *
@@ -101,11 +135,23 @@ namespace eosio {
          **/
         [[eosio::action]]
         void unstake( account_name account, asset quantity, symbol_type symbol);
+
+        /**
+         * Register the brand token contract that hosts a brand symbol. A brand
+         * staked before the registry existed has its staked TAPx seeded from
+         * the max supply its contract already holds
+         *
+         * @param symbol      brand token symbol, Example 0.0000 GDP
+         * @param contract    brandedtoken contract account hosting the symbol
+         * @param staker      EOS account allowed to stake TAPx for the brand
+         **/
+        [[eosio::action]]
+        void regbrand( symbol_type symbol, account_name contract, account_name staker );
          
          /**
          * Deposit TAPx from EOS account into ledger account
          *
-         * @param tapx_from  EOS account that send TAPx 
+         * @param tapx_from  EOS account that send TAPx, pays the RAM of a ledger the deposit opens
          * @param ledger_to  ledger account that receive TAPx
          * @param quantity   TAPx quantity
          **/
@@ -118,9 +164,10 @@ namespace eosio {
          * @param ledger_from  ledger account that send TAPx
          * @param tap_to       EOS account that receive TAPx 
          * @param quantity     TAPx quantity
+         * @param opid         client operation id, a replay within the dedup window is a no-op; 0 for none
          **/
          [[eosio::action]]
-         void wdrledger(account_name ledger_from, account_name tapx_to, asset quantity);
+         void wdrledger(account_name ledger_from, account_name tapx_to, asset quantity, uint64_t opid);
 
          /**
          * Transfer TAPx between ledger accounts
@@ -128,22 +175,53 @@ namespace eosio {
          * @param lgid_from  ledger account that send TAPx
          * @param lgid_to  ledger account that receive TAPx
          * @param quantity  transfer asset quantity         
+         * @param opid  client operation id, a replay within the dedup window is a no-op; 0 for none
          **/
          [[eosio::action]]
-         void trfledger( account_name ledger_from, account_name ledger_to, asset quantity);
+         void trfledger( account_name ledger_from, account_name ledger_to, asset quantity, uint64_t opid);
 
          /**
-         * Create new account on ledger
+         * Create new account on ledger ahead of its first credit. Optional,
+         * depledger and trfledger open the recipient's ledger themselves
          *
          * @param ledger  new ledger ID
          **/
          [[eosio::action]]
          void createlgid(account_name ledger_id);
 
+         /**
+         * Move legacy tapbalances rows to the compact tapledgers table
+         *
+         * @param max_rows  rows to move in this action
+         **/
+         [[eosio::action]]
+         void migrate(uint32_t max_rows);
+
+         /**
+         * Read-only: TAPx balances of many holders in one call, returned
+         * packed as a balance_page in the action return value
+         *
+         * @param owners      EOS accounts
+         * @param ledger_ids  ledger accounts
+         **/
+         [[eosio::action]]
+         void getbalances( vector<account_name> owners, vector<account_name> ledger_ids );
+
+         /**
+         * Move dormant ledgers to the packed cold tier, they return to a hot row
+         * on their next ledger action. IDs not holding a hot row are skipped.
+         *
+         * @param ledger_ids  up to cold_demote_batch ledger accounts
+         **/
+         [[eosio::action]]
+         void demote( vector<account_name> ledger_ids );
+
          inline asset get_supply( symbol_name sym )const;
          
          inline asset get_balance( account_name owner, symbol_name sym )const;
 
+         inline uint64_t get_reputation( account_name ledger_id, symbol_name sym )const;
+
       private:
          struct [[eosio::table]] account {
             asset    balance;
@@ -164,10 +242,14 @@ namespace eosio {
 
          void sub_balance( account_name owner, asset value );
          void add_balance( account_name owner, asset value, account_name ram_payer );
+         void check_symbol( const asset& quantity )const;
+         void move_balance( account_name from, account_name to, asset quantity, string memo );
+         void deposit_custody( account_name from, uint64_t lgid, asset quantity );
+         void withdraw_custody( uint64_t lgid, account_name to, asset quantity );
 
-         //Ledger TAP balance table
+         //Legacy ledger TAP balance table, rows move to tapledgers by migrate or on first touch
          struct [[eosio::table]] tapbalance {
-            account_name    ledger_id;       // will create a secondary index on this
+            account_name    ledger_id;
             asset           balance;
 
             auto            primary_key()const { return ledger_id; }
@@ -175,22 +257,60 @@ namespace eosio {
          };
          typedef eosio::multi_index<N(tapbalances), tapbalance> tapbalances;
 
-        /**
-         * Inline action TAPx transfer
-         *
-         * @param from    EOS account that send TAPx
-         * @param to      EOS account that receive TAPx
-         * @param asset   transfer TAPx asset info
-         * @param memo    memo
-         **/
-        void trf_tapx( account_name from, account_name to, asset quantity, string memo ) {
-            action(
-                permission_level{from,N(active)},
-                get_self(),      
-                N(transfer),
-                std::make_tuple(from, to, quantity,memo)
-            ).send();
-        }
+         //Ledger TAP balance table, scoped by the full TAP symbol so rows only
+         //carry the amount: 16 bytes of payload instead of 24.
+         //With -DTAPX_LEADERBOARD, byamount ranks ledgers by balance: top-K is a
+         //reverse scan from the end, rank of a ledger is the count of rows above
+         //its amount. The index bills 128 bytes of RAM per ledger on top of the
+         //row's 124, and every balance change also updates it.
+         struct [[eosio::table]] tapledger {
+            account_name    ledger_id;
+            int64_t         amount;
+
+            auto            primary_key()const { return ledger_id; }
+            uint64_t        by_amount()const { return uint64_t(amount); }
+            EOSLIB_SERIALIZE( tapledger, (ledger_id)(amount))
+         };
+#ifdef TAPX_LEADERBOARD
+         typedef eosio::multi_index<N(tapledgers), tapledger,
+            indexed_by<N(byamount), const_mem_fun<tapledger, uint64_t, &tapledger::by_amount>>
+         > tapledgers;
+#else
+         typedef eosio::multi_index<N(tapledgers), tapledger> tapledgers;
+#endif
+
+         //Dormant ledger TAP balances, packed by ranges of ledger hashes, scoped like tapledgers
+         typedef eosio::multi_index<N(tapcolds), coldledger> tapcolds;
+
+         tapledgers::const_iterator find_ledger( tapledgers& ledgers, account_name ledger_id );
+         void sub_ledger( account_name ledger_id, asset value );
+         void add_ledger( account_name ledger_id, asset value, account_name ram_payer );
+
+         //Ledger reputation, scoped by ledger symbol name. score is stored as of
+         //updated and decayed lazily on the next read or write, never swept.
+         struct [[eosio::table]] reputation {
+            account_name    ledger_id;
+            uint64_t        score;
+            uint32_t        updated;
+
+            auto            primary_key()const { return ledger_id; }
+            EOSLIB_SERIALIZE( reputation, (ledger_id)(score)(updated))
+         };
+         typedef eosio::multi_index<N(reputations), reputation> reputations;
+
+         void add_reputation( symbol_name sym, account_name ledger_id, uint64_t points );
+
+         //Brand registry, routes stake/unstake by brand symbol
+         struct [[eosio::table]] brandreg {
+            symbol_type     symbol;
+            account_name    contract;
+            account_name    staker;
+            asset           staked;          // TAPx held by this contract for the brand
+
+            uint64_t        primary_key()const { return symbol.name(); }
+            EOSLIB_SERIALIZE( brandreg, (symbol)(contract)(staker)(staked))
+         };
+         typedef eosio::multi_index<N(brandregs), brandreg> brandregs;
 
         /**
          * Inline action add brand token supply
@@ -200,6 +320,7 @@ namespace eosio {
          * @param memo         memo
          **/
         void add_supply(account_name brandaccount,asset quantity, string memo ) {
+            PROFILE_SENDS( 1 );
             action(
                 permission_level{get_self(),N(active)},
                 brandaccount,       
@@ -216,6 +337,7 @@ namespace eosio {
          * @param memo         memo
          **/
         void sub_supply(account_name brandaccount,asset quantity, string memo ) {
+            PROFILE_SENDS( 1 );
             action(
                 permission_level{get_self(),N(active)},
                 brandaccount,      
@@ -247,4 +369,12 @@ namespace eosio {
       return ac.balance;
    }
 
+   uint64_t tapx::get_reputation( account_name ledger_id, symbol_name sym )const
+   {
+      reputations reptable( _self, sym );
+      auto rep = reptable.find( ledger_id );
+      if( rep == reptable.end() ) return 0;
+      return decay_score( rep->score, now() - rep->updated, reputation_half_life );
+   }
+
 } /// namespace eosio
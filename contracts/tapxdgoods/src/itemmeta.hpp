@@ -0,0 +1,284 @@
+/**
+ *  itemmeta.hpp
+ *  copyright TAPx.io
+ *
+ *  Compact binary encoding of the item schema in tapxdgoods.json, shared by
+ *  the contract and the native tools, with no eosio dependency.
+ *
+ *  Strings are a varuint32 byte length followed by UTF-8 bytes.
+ *
+ *    uint8      version
+ *    uint8      flags, bit 0 set if authenticityImage is present
+ *    string     name
+ *    string     description
+ *    uri        imageSmall
+ *    uri        imageLarge
+ *    uri        authenticityImage, if flagged
+ *    varuint32  number of details, then for each
+ *      string     key
+ *      uint8      value type
+ *      value      string, zigzag varint64 or uint8 by type
+ *
+ *  A uri is a uint8 index into uri_schemes followed by the rest as a string.
+ *
+ *  Every item has exactly one encoding: varints are minimal, a uri uses its
+ *  longest matching scheme, and decode rejects anything encode would not
+ *  produce, so equal bytes mean equal metadata.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace itemmeta {
+
+	static constexpr uint8_t version = 1;
+	static constexpr uint8_t flag_authenticity = 1;
+
+	static constexpr size_t max_name = 64;
+	static constexpr size_t max_description = 1024;
+	static constexpr size_t max_uri = 256;
+	static constexpr size_t max_details = 32;
+	static constexpr size_t max_key = 32;
+	static constexpr size_t max_text = 256;
+
+	// scheme prefixes stored as one byte, the longest match wins, 0 keeps the uri verbatim
+	static const char* const uri_schemes[] = { "", "https://", "http://", "ipfs://", "ar://" };
+	static constexpr uint8_t uri_scheme_count = 5;
+
+	enum value_type : uint8_t {
+		value_string = 0,
+		value_int,
+		value_bool
+	};
+
+	struct attribute {
+		std::string key;
+		value_type  type = value_string;
+		std::string text;        // value_string
+		int64_t     number = 0;  // value_int, or 0/1 for value_bool
+	};
+
+	struct item {
+		std::string name;
+		std::string description;
+		std::string image_small;
+		std::string image_large;
+		std::string authenticity_image;   // empty if absent
+		std::vector<attribute> details;
+	};
+
+	// well-formed UTF-8 as in RFC 3629: no overlong forms, surrogates or code points past U+10FFFF
+	inline bool valid_utf8( const std::string& s ) {
+		size_t i = 0;
+		while( i < s.size() ) {
+			unsigned char c = s[i];
+			size_t n;
+			unsigned char lo = 0x80, hi = 0xbf;   // range of the second byte
+			if( c < 0x80 ) n = 0;
+			else if( c >= 0xc2 && c <= 0xdf ) n = 1;
+			else if( c >= 0xe0 && c <= 0xef ) {
+				n = 2;
+				if( c == 0xe0 ) lo = 0xa0;
+				if( c == 0xed ) hi = 0x9f;
+			} else if( c >= 0xf0 && c <= 0xf4 ) {
+				n = 3;
+				if( c == 0xf0 ) lo = 0x90;
+				if( c == 0xf4 ) hi = 0x8f;
+			} else return false;
+			if( i + n >= s.size() ) return false;
+			for( size_t k = 1; k <= n; ++k ) {
+				unsigned char b = s[i + k];
+				if( b < (k == 1 ? lo : 0x80) || b > (k == 1 ? hi : 0xbf) ) return false;
+			}
+			i += n + 1;
+		}
+		return true;
+	}
+
+	// index of the longest scheme prefixing uri, 0 if none
+	inline uint8_t uri_scheme_of( const std::string& uri ) {
+		uint8_t scheme = 0;
+		size_t len = 0;
+		for( uint8_t i = 1; i < uri_scheme_count; ++i ) {
+			std::string prefix = uri_schemes[i];
+			if( prefix.size() > len && uri.compare( 0, prefix.size(), prefix ) == 0 ) {
+				scheme = i;
+				len = prefix.size();
+			}
+		}
+		return scheme;
+	}
+
+	inline bool valid_text( const std::string& s, size_t max ) {
+		return s.size() <= max && valid_utf8( s );
+	}
+
+	/**
+	 * Check an item against the schema
+	 *
+	 * @return nullptr if valid, else the reason
+	 **/
+	inline const char* validate( const item& it ) {
+		if( it.name.empty() || !valid_text( it.name, max_name ) ) return "invalid item name";
+		if( !valid_text( it.description, max_description ) ) return "invalid item description";
+		if( it.image_small.empty() || !valid_text( it.image_small, max_uri ) ) return "invalid imageSmall";
+		if( it.image_large.empty() || !valid_text( it.image_large, max_uri ) ) return "invalid imageLarge";
+		if( !valid_text( it.authenticity_image, max_uri ) ) return "invalid authenticityImage";
+		if( it.details.size() > max_details ) return "too many details";
+		for( size_t i = 0; i < it.details.size(); ++i ) {
+			const attribute& a = it.details[i];
+			if( a.key.empty() || !valid_text( a.key, max_key ) ) return "invalid detail key";
+			if( a.type > value_bool ) return "invalid detail type";
+			if( a.type == value_string && !valid_text( a.text, max_text ) ) return "invalid detail value";
+			if( a.type == value_bool && a.number != 0 && a.number != 1 ) return "invalid detail value";
+			for( size_t j = 0; j < i; ++j ) {
+				if( it.details[j].key == a.key ) return "duplicate detail key";
+			}
+		}
+		return nullptr;
+	}
+
+	namespace impl {
+
+		inline void put_varuint( std::vector<char>& out, uint64_t v ) {
+			do {
+				uint8_t b = v & 0x7f;
+				v >>= 7;
+				out.push_back( char( b | (v ? 0x80 : 0) ) );
+			} while( v );
+		}
+
+		inline void put_string( std::vector<char>& out, const std::string& s ) {
+			put_varuint( out, s.size() );
+			out.insert( out.end(), s.begin(), s.end() );
+		}
+
+		inline void put_uri( std::vector<char>& out, const std::string& uri ) {
+			uint8_t scheme = uri_scheme_of( uri );
+			out.push_back( char( scheme ) );
+			put_string( out, uri.substr( std::string( uri_schemes[scheme] ).size() ) );
+		}
+
+		struct reader {
+			const unsigned char* p;
+			const unsigned char* end;
+			const char*          error;   // why a read failed, if not for lack of bytes
+
+			const char* fail()const { return error ? error : "truncated metadata"; }
+
+			bool byte( uint8_t& b ) {
+				if( p >= end ) return false;
+				b = *p++;
+				return true;
+			}
+
+			// minimal encodings only: no trailing zero group, no bits past the width
+			bool varuint( uint64_t& v, uint32_t bits ) {
+				v = 0;
+				for( uint32_t shift = 0; shift < bits; shift += 7 ) {
+					uint8_t b;
+					if( !byte( b ) ) return false;
+					if( (shift + 7 > bits && ((b & 0x7f) >> (bits - shift))) || (b == 0 && shift > 0) ) {
+						error = "non-minimal varint";
+						return false;
+					}
+					v |= uint64_t( b & 0x7f ) << shift;
+					if( !(b & 0x80) ) return true;
+				}
+				return false;
+			}
+
+			bool string( std::string& s, size_t max ) {
+				uint64_t len;
+				if( !varuint( len, 32 ) || len > max || len > uint64_t( end - p ) ) return false;
+				s.assign( reinterpret_cast<const char*>( p ), size_t( len ) );
+				p += len;
+				return true;
+			}
+
+			bool uri( std::string& s ) {
+				uint8_t scheme;
+				if( !byte( scheme ) || scheme >= uri_scheme_count || !string( s, max_uri ) ) return false;
+				s.insert( 0, uri_schemes[scheme] );
+				if( s.size() > max_uri ) return false;
+				if( uri_scheme_of( s ) != scheme ) {
+					error = "non-canonical uri scheme";
+					return false;
+				}
+				return true;
+			}
+		};
+
+	} /// namespace impl
+
+	// encode a validated item
+	inline std::vector<char> encode( const item& it ) {
+		std::vector<char> out;
+		out.push_back( char( version ) );
+		out.push_back( char( it.authenticity_image.empty() ? 0 : flag_authenticity ) );
+		impl::put_string( out, it.name );
+		impl::put_string( out, it.description );
+		impl::put_uri( out, it.image_small );
+		impl::put_uri( out, it.image_large );
+		if( !it.authenticity_image.empty() ) impl::put_uri( out, it.authenticity_image );
+		impl::put_varuint( out, it.details.size() );
+		for( const auto& a : it.details ) {
+			impl::put_string( out, a.key );
+			out.push_back( char( a.type ) );
+			switch( a.type ) {
+				case value_string: impl::put_string( out, a.text ); break;
+				case value_int:    impl::put_varuint( out, (uint64_t( a.number ) << 1) ^ uint64_t( a.number >> 63 ) ); break;
+				case value_bool:   out.push_back( char( a.number ? 1 : 0 ) ); break;
+			}
+		}
+		return out;
+	}
+
+	/**
+	 * Decode and validate encoded metadata
+	 *
+	 * @return nullptr on success, else the reason
+	 **/
+	inline const char* decode( const char* data, size_t size, item& it ) {
+		impl::reader r{ reinterpret_cast<const unsigned char*>( data ), reinterpret_cast<const unsigned char*>( data ) + size, nullptr };
+		uint8_t ver, flags;
+		if( !r.byte( ver ) || ver != version ) return "unsupported metadata version";
+		if( !r.byte( flags ) || (flags & ~flag_authenticity) ) return "invalid metadata flags";
+		if( !r.string( it.name, max_name ) || !r.string( it.description, max_description ) ||
+		    !r.uri( it.image_small ) || !r.uri( it.image_large ) ) return r.fail();
+		it.authenticity_image.clear();
+		if( (flags & flag_authenticity) && !r.uri( it.authenticity_image ) ) return r.fail();
+		if( (flags & flag_authenticity) && it.authenticity_image.empty() ) return "invalid authenticityImage";
+
+		uint64_t count;
+		if( !r.varuint( count, 32 ) ) return r.fail();
+		if( count > max_details ) return "invalid detail count";
+		it.details.assign( size_t( count ), attribute() );
+		for( auto& a : it.details ) {
+			uint8_t type;
+			if( !r.string( a.key, max_key ) || !r.byte( type ) ) return r.fail();
+			a.type = value_type( type );
+			uint64_t v;
+			switch( a.type ) {
+				case value_string:
+					if( !r.string( a.text, max_text ) ) return r.fail();
+					break;
+				case value_int:
+					if( !r.varuint( v, 64 ) ) return r.fail();
+					a.number = int64_t( v >> 1 ) ^ -int64_t( v & 1 );
+					break;
+				case value_bool:
+					if( !r.byte( type ) ) return r.fail();
+					a.number = type;
+					break;
+				default:
+					return "invalid detail type";
+			}
+		}
+		if( r.p != r.end ) return "trailing metadata bytes";
+		return validate( it );
+	}
+
+} /// namespace itemmeta
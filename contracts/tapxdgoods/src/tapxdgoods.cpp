@@ -1,19 +1,46 @@
 #include "tapxdgoods.hpp"
 
+#include <cstring>
+
 using namespace eosio;
 using std::string;
 
+namespace {
+
+	checksum256 hash_node(const checksum256& left, const checksum256& right) {
+		char buf[65];
+		buf[0] = 1;
+		auto l = left.extract_as_byte_array();
+		auto r = right.extract_as_byte_array();
+		memcpy(buf + 1, l.data(), 32);
+		memcpy(buf + 33, r.data(), 32);
+		return sha256(buf, sizeof(buf));
+	}
+
+	checksum256 hash_leaf(uint32_t index, name to) {
+		char buf[13];
+		buf[0] = 0;
+		memcpy(buf + 1, &index, 4);
+		memcpy(buf + 5, &to.value, 8);
+		return sha256(buf, sizeof(buf));
+	}
+
+}
+
 void tapxdgoods::create(name issuer, name token_name, bool fungible, bool
       burnable, bool transferable, uint64_t max_supply) 
 {
+	 PROFILE_SECTION( "create" );
 	 require_auth( _self );
 
 	 auto nft_dasset = dasset{ max_supply, 0 };
 
 	 tokenstats_index tokenstats_table(_self,token_name.value);
+	 PROFILE_READS( 1 );
 	 auto existing = tokenstats_table.find(token_name.value);
 	 check( existing == tokenstats_table.end(), "nft allread eixts"); 
 
+	 PROFILE_WRITES( 1 );
 	 tokenstats_table.emplace( _self, [&]( auto& row ) {
 	 	row.fungible = fungible;
 	 	row.burnable = burnable;
@@ -29,7 +56,26 @@ void tapxdgoods::create(name issuer, name token_name, bool fungible, bool
 **/
 void tapxdgoods::issue(name to, name token_name, string metadata_type, 
      string metadata_uri, string memo) {
+	 PROFILE_SECTION( "issue" );
+	 add_item(to, token_name, metadata_type, metadata_uri, nullptr);
+}
+
+void tapxdgoods::issueitem(name to, name token_name, vector<char> metadata, string memo) {
+	 PROFILE_SECTION( "issueitem" );
+	 check( memo.size() <= 256, "memo has more than 256 bytes" );
+
+	 itemmeta::item item;
+	 const char* error = itemmeta::decode(metadata.data(), metadata.size(), item);
+	 check( error == nullptr, error ? error : "" );
+
+	 add_item(to, token_name, "itemmeta", "", &metadata);
+}
+
+void tapxdgoods::add_item(name to, name token_name, string metadata_type, 
+     string metadata_uri, vector<char>* metadata) {
+	 PROFILE_SECTION( "add_item" );
 	 tokenstats_index tokenstats_table(_self,token_name.value);
+	 PROFILE_READS( 1 );
 	 auto existing = tokenstats_table.find(token_name.value);
 	 check( existing != tokenstats_table.end(), "token with symbol does not exist, create token before issue"); 
 
@@ -38,43 +84,200 @@ void tapxdgoods::issue(name to, name token_name, string metadata_type,
 
 	 check( 1 <= ts.max_supply.amount - ts.current_supply,  "quantity exceeds available supply");
 
+	 PROFILE_WRITES( 1 );
 	 tokenstats_table.modify( ts, same_payer,[&]( auto& row ) {
 		row.current_supply += 1;
 	 });
 
 	 owner_index tokeninfo_table(_self,_self.value);
+	 uint64_t serial = reserve_serials(1);
 
+	 PROFILE_WRITES( 1 );
 	 tokeninfo_table.emplace( _self, [&]( auto& row ) {
-	 	row.serial_number = tokeninfo_table.available_primary_key();
+	 	row.serial_number = serial;
 	 	row.owner = to;
 	 	row.token_name = token_name;
 	 	row.metadata_type = metadata_type;
 	 	row.metadata_uri = metadata_uri;
+	 	if (metadata) row.metadata.emplace(std::move(*metadata));
+	 });
+}
+
+
+uint64_t tapxdgoods::reserve_serials(uint64_t count) {
+	 PROFILE_SECTION( "reserve_serials" );
+	 serial_index serials(_self,_self.value);
+	 serialstate state;
+	 PROFILE_READS( 1 );
+	 if( serials.exists() ) {
+	 	PROFILE_READS( 1 );
+	 	state = serials.get();
+	 } else {
+	 	// first use, continue after the items issued before serials were tracked
+	 	owner_index tokeninfo_table(_self,_self.value);
+	 	PROFILE_READS( 1 );
+	 	state.next_serial = tokeninfo_table.available_primary_key();
+	 }
+	 uint64_t first = state.next_serial;
+	 state.next_serial += count;
+	 // set looks the row up again before writing it
+	 PROFILE_READS( 1 );
+	 PROFILE_WRITES( 1 );
+	 serials.set(state, _self);
+	 return first;
+}
+
+void tapxdgoods::createvouch(name token_name, uint32_t count, checksum256 root,
+     string metadata_type, string metadata_uri) {
+	 PROFILE_SECTION( "createvouch" );
+	 check( count > 0 && count <= max_voucher_items, "invalid voucher count" );
+	 check( metadata_uri.size() <= 256, "metadata_uri has more than 256 bytes" );
+
+	 tokenstats_index tokenstats_table(_self,token_name.value);
+	 PROFILE_READS( 1 );
+	 const auto& ts = tokenstats_table.get(token_name.value, "token with symbol does not exist, create token before issue");
+	 require_auth(ts.issuer);
+
+	 // the whole range counts against supply until it is claimed or released
+	 check( count <= ts.max_supply.amount - ts.current_supply, "quantity exceeds available supply");
+	 PROFILE_WRITES( 1 );
+	 tokenstats_table.modify( ts, same_payer,[&]( auto& row ) {
+		row.current_supply += count;
+	 });
+
+	 voucher_index voucher_table(_self,_self.value);
+	 uint64_t first = reserve_serials(count);
+	 PROFILE_WRITES( 1 );
+	 voucher_table.emplace( _self, [&]( auto& row ) {
+	 	row.first_serial = first;
+	 	row.token_name = token_name;
+	 	row.count = count;
+	 	row.claimed = 0;
+	 	row.closed = false;
+	 	row.root = root;
+	 	row.metadata_type = metadata_type;
+	 	row.metadata_uri = metadata_uri;
+	 });
+}
+
+void tapxdgoods::claimvouch(name to, uint64_t voucher_id, uint32_t index, vector<checksum256> proof) {
+	 PROFILE_SECTION( "claimvouch" );
+	 check( is_account( to ), "to account does not exist");
+
+	 voucher_index voucher_table(_self,_self.value);
+	 PROFILE_READS( 1 );
+	 const auto& v = voucher_table.get(voucher_id, "voucher doesn't exist");
+	 check( !v.closed, "voucher is closed" );
+	 check( index < v.count, "index outside voucher" );
+	 check( proof.size() <= max_voucher_depth && (uint64_t(index) >> proof.size()) == 0, "invalid proof length" );
+
+	 checksum256 node = hash_leaf(index, to);
+	 for( size_t level = 0; level < proof.size(); ++level ) {
+	 	node = (index >> level) & 1 ? hash_node(proof[level], node) : hash_node(node, proof[level]);
+	 }
+	 check( node == v.root, "recipient not in voucher" );
+
+	 voucherclaim_index claims(_self,voucher_id);
+	 uint64_t word = index >> 6;
+	 uint64_t bit = 1ULL << (index & 63);
+	 PROFILE_READS( 1 );
+	 auto c = claims.find(word);
+	 if( c == claims.end() ) {
+	 	PROFILE_WRITES( 1 );
+	 	claims.emplace( _self, [&]( auto& row ) {
+	 		row.word = word;
+	 		row.bits = bit;
+	 	});
+	 } else {
+	 	check( !(c->bits & bit), "voucher already claimed" );
+	 	PROFILE_WRITES( 1 );
+	 	claims.modify( c, same_payer, [&]( auto& row ) {
+	 		row.bits |= bit;
+	 	});
+	 }
+
+	 PROFILE_WRITES( 1 );
+	 voucher_table.modify( v, same_payer, [&]( auto& row ) {
+	 	row.claimed += 1;
+	 });
+
+	 owner_index tokeninfo_table(_self,_self.value);
+	 PROFILE_WRITES( 1 );
+	 tokeninfo_table.emplace( _self, [&]( auto& row ) {
+	 	row.serial_number = v.first_serial + index;
+	 	row.owner = to;
+	 	row.token_name = v.token_name;
+	 	row.metadata_type = v.metadata_type;
+	 	row.metadata_uri = v.metadata_uri;
 	 });
+	 require_recipient( to );
+	 PROFILE_NOTIFIES( 1 );
 }
 
+void tapxdgoods::closevouch(uint64_t voucher_id) {
+	 PROFILE_SECTION( "closevouch" );
+	 voucher_index voucher_table(_self,_self.value);
+	 PROFILE_READS( 1 );
+	 const auto& v = voucher_table.get(voucher_id, "voucher doesn't exist");
+
+	 tokenstats_index tokenstats_table(_self,v.token_name.value);
+	 PROFILE_READS( 1 );
+	 const auto& ts = tokenstats_table.get(v.token_name.value, "token with symbol does not exist");
+	 require_auth(ts.issuer);
+
+	 if( !v.closed ) {
+	 	PROFILE_WRITES( 1 );
+	 	tokenstats_table.modify( ts, same_payer,[&]( auto& row ) {
+	 		row.current_supply -= v.count - v.claimed;
+	 	});
+	 	PROFILE_WRITES( 1 );
+	 	voucher_table.modify( v, same_payer, [&]( auto& row ) {
+	 		row.closed = true;
+	 	});
+	 }
+
+	 voucherclaim_index claims(_self,voucher_id);
+	 uint32_t erased = 0;
+	 PROFILE_READS( 1 );
+	 for( auto c = claims.begin(); c != claims.end() && erased < voucher_close_batch; ++erased ) {
+	 	// erase steps to the next row
+	 	PROFILE_READS( 1 );
+	 	PROFILE_WRITES( 1 );
+	 	c = claims.erase(c);
+	 }
+	 PROFILE_READS( 1 );
+	 if( claims.begin() == claims.end() ) {
+	 	PROFILE_WRITES( 1 );
+	 	voucher_table.erase(v);
+	 }
+}
 
 void tapxdgoods::burnnft(name owner, vector<uint64_t> tokeninfo_ids) {
+	PROFILE_SECTION( "burnnft" );
 	require_auth(owner);
 
 	for (vector<uint64_t>::const_iterator iter = tokeninfo_ids.cbegin(); iter != tokeninfo_ids.cend(); iter++)
 	{
 		owner_index owner_account(_self,_self.value);
+		PROFILE_READS( 1 );
 		auto owner_nft = owner_account.find(*iter);
 		check( owner_nft != owner_account.end(), "nft didn't eixts"); 
 		check( owner_nft-> owner == owner, "owner doses not own token with specified ID");
 
-		owner_account.erase(owner_nft); 
+		PROFILE_WRITES( 1 );
+		owner_account.erase(*owner_nft);
 	}
 }
 
 void tapxdgoods::transfernft(name from, name to, vector<uint64_t> tokeninfo_ids, string memo) {
+	PROFILE_SECTION( "transfernft" );
 	check( from != to , "cannot transfer to self" );
 	require_auth( from );
 	check( is_account( to ) , "to account does not exist");
 
 	require_recipient( from );
 	require_recipient( to );
+	PROFILE_NOTIFIES( 2 );
 
 	check( memo.size() <= 256, "memo has more than 256 bytes" );
 
@@ -82,16 +285,196 @@ void tapxdgoods::transfernft(name from, name to, vector<uint64_t> tokeninfo_ids,
 	for (vector<uint64_t>::const_iterator iter = tokeninfo_ids.cbegin(); iter != tokeninfo_ids.cend(); iter++)
 	{
 		owner_index from_account(_self,_self.value);
+		PROFILE_READS( 1 );
 		auto send_nft = from_account.find(*iter);
 		// check( false, *iter);
 		check( send_nft != from_account.end(), "nft didn't eixts"); 
 		check( send_nft-> owner == from, "sender doses not own token with specified ID");
 
 		const auto& ts = *send_nft;
+		PROFILE_WRITES( 1 );
 		from_account.modify( ts, same_payer,[&]( auto& row ) {
 			row.owner = to;
 		});
 	}
 }
 
-EOSIO_DISPATCH(tapxdgoods, (create)(issue)(burnnft)(transfernft))
\ No newline at end of file
+void tapxdgoods::list(name seller, vector<uint64_t> tokeninfo_ids, name token_contract, asset price) {
+	PROFILE_SECTION( "list" );
+	require_auth( seller );
+	check( is_account( token_contract ), "token contract account does not exist");
+	check( token_contract != _self, "items cannot be priced in this contract");
+	check( price.is_valid(), "invalid price" );
+	check( price.amount > 0, "price must be positive" );
+
+	owner_index tokeninfo_table(_self,_self.value);
+	listing_index listing_table(_self,_self.value);
+	for (vector<uint64_t>::const_iterator iter = tokeninfo_ids.cbegin(); iter != tokeninfo_ids.cend(); iter++)
+	{
+		PROFILE_READS( 1 );
+		auto nft = tokeninfo_table.find(*iter);
+		check( nft != tokeninfo_table.end(), "nft didn't eixts"); 
+		check( nft-> owner == seller, "seller doses not own token with specified ID");
+
+		tokenstats_index tokenstats_table(_self,nft->token_name.value);
+		PROFILE_READS( 1 );
+		const auto& ts = tokenstats_table.get(nft->token_name.value, "token with symbol does not exist");
+		check( ts.transferable, "token is not transferable");
+
+		// escrow: the contract holds the item until it is bought or delisted
+		PROFILE_WRITES( 1 );
+		tokeninfo_table.modify( nft, same_payer,[&]( auto& row ) {
+			row.owner = _self;
+		});
+
+		PROFILE_WRITES( 1 );
+		listing_table.emplace( seller, [&]( auto& row ) {
+			row.serial_number = *iter;
+			row.seller = seller;
+			row.token_name = nft->token_name;
+			row.token_contract = token_contract;
+			row.price = price;
+		});
+	}
+}
+
+void tapxdgoods::delist(name seller, vector<uint64_t> tokeninfo_ids) {
+	PROFILE_SECTION( "delist" );
+	require_auth( seller );
+
+	owner_index tokeninfo_table(_self,_self.value);
+	listing_index listing_table(_self,_self.value);
+	for (vector<uint64_t>::const_iterator iter = tokeninfo_ids.cbegin(); iter != tokeninfo_ids.cend(); iter++)
+	{
+		PROFILE_READS( 1 );
+		auto lst = listing_table.find(*iter);
+		check( lst != listing_table.end(), "listing doesn't exist");
+		check( lst-> seller == seller, "seller doses not own listing with specified ID");
+
+		PROFILE_READS( 1 );
+		const auto& nft = tokeninfo_table.get(*iter, "nft didn't eixts");
+		PROFILE_WRITES( 1 );
+		tokeninfo_table.modify( nft, same_payer,[&]( auto& row ) {
+			row.owner = seller;
+		});
+		PROFILE_WRITES( 1 );
+		listing_table.erase(*lst);
+	}
+}
+
+void tapxdgoods::onpayment(name from, name to, asset quantity, string memo) {
+	// payouts and refunds this contract sends, and transfers meant for it, are not purchases
+	if( from == _self || to != _self ) return;
+	if( memo.compare(0, 4, "buy:") != 0 ) return;
+	PROFILE_SECTION( "onpayment" );
+	check( quantity.is_valid(), "invalid quantity" );
+	name token_name( std::string_view(memo).substr(4) );
+	name token_contract = get_first_receiver();
+
+	listing_index listing_table(_self,_self.value);
+	auto byprice = listing_table.get_index<"byprice"_n>();
+
+	// the key leads with (token_name, token_contract, symbol), so the lower bound is the
+	// cheapest listing paid in exactly this token
+	PROFILE_READS( 1 );
+	auto lst = byprice.lower_bound( listing::price_key(token_name, token_contract, quantity.symbol, 0) );
+	check( lst != byprice.end() && lst->token_name == token_name && lst->token_contract == token_contract
+	       && lst->price.symbol == quantity.symbol, "no listing for token in this currency");
+	check( lst->price.amount <= quantity.amount, "cheapest listing exceeds payment");
+	check( lst->seller != from, "cannot buy own listing");
+
+	uint64_t serial_number = lst->serial_number;
+	name seller = lst->seller;
+	asset price = lst->price;
+
+	// settle from the payment this contract now holds, only its own eosio.code is needed
+	PROFILE_SENDS( 1 );
+	action(
+		permission_level{_self, "active"_n},
+		token_contract,
+		"transfer"_n,
+		std::make_tuple(_self, seller, price, "sale of item " + std::to_string(serial_number))
+	).send();
+	if( quantity.amount > price.amount ) {
+		PROFILE_SENDS( 1 );
+		action(
+			permission_level{_self, "active"_n},
+			token_contract,
+			"transfer"_n,
+			std::make_tuple(_self, from, quantity - price, string("change for item ") + std::to_string(serial_number))
+		).send();
+	}
+
+	owner_index tokeninfo_table(_self,_self.value);
+	PROFILE_READS( 1 );
+	const auto& nft = tokeninfo_table.get(serial_number, "nft didn't eixts");
+	PROFILE_WRITES( 1 );
+	tokeninfo_table.modify( nft, same_payer,[&]( auto& row ) {
+		row.owner = from;
+	});
+
+	PROFILE_WRITES( 1 );
+	listing_table.erase(*lst);
+
+	PROFILE_SENDS( 1 );
+	action(
+		permission_level{_self, "active"_n},
+		_self,
+		"logsale"_n,
+		std::make_tuple(from, seller, serial_number, price, token_contract)
+	).send();
+}
+
+void tapxdgoods::logsale(name buyer, name seller, uint64_t serial_number, asset price, name token_contract) {
+	PROFILE_SECTION( "logsale" );
+	require_auth( _self );
+	require_recipient( buyer );
+	require_recipient( seller );
+	PROFILE_NOTIFIES( 2 );
+}
+
+vector<tapxdgoods::token_owner> tapxdgoods::getowners(vector<uint64_t> tokeninfo_ids) {
+	PROFILE_SECTION( "getowners" );
+	check( tokeninfo_ids.size() <= 256, "too many keys" );
+
+	owner_index tokeninfo_table(_self,_self.value);
+	listing_index listing_table(_self,_self.value);
+	vector<token_owner> owners;
+	owners.reserve( tokeninfo_ids.size() );
+	for (auto id : tokeninfo_ids)
+	{
+		token_owner o{ id, name(), name(), false };
+		PROFILE_READS( 1 );
+		auto nft = tokeninfo_table.find(id);
+		if( nft != tokeninfo_table.end() ) {
+			o.owner = nft->owner;
+			o.token_name = nft->token_name;
+			// escrowed items report their seller
+			if( nft->owner == _self ) {
+				PROFILE_READS( 1 );
+				auto sale = listing_table.find(id);
+				if( sale != listing_table.end() ) {
+					o.owner = sale->seller;
+					o.listed = true;
+				}
+			}
+		}
+		owners.push_back( o );
+	}
+	return owners;
+}
+
+// EOSIO_DISPATCH only runs this contract's own actions, token transfer notifications
+// are routed to onpayment here
+extern "C" {
+	[[eosio::wasm_entry]]
+	void apply(uint64_t receiver, uint64_t code, uint64_t action) {
+		if( code == receiver ) {
+			switch( action ) {
+				EOSIO_DISPATCH_HELPER(tapxdgoods, (create)(issue)(issueitem)(createvouch)(claimvouch)(closevouch)(burnnft)(transfernft)(list)(delist)(logsale)(getowners))
+			}
+		} else if( action == "transfer"_n.value ) {
+			eosio::execute_action( name(receiver), name(code), &tapxdgoods::onpayment );
+		}
+	}
+}
\ No newline at end of file
@@ -2,21 +2,44 @@
  *  tapxdgoods.hpp
  *  copyright TAPx.io
  */
+#include <eosio/asset.hpp>
+#include <eosio/binary_extension.hpp>
+#include <eosio/crypto.hpp>
 #include <eosio/eosio.hpp>
+#include <eosio/singleton.hpp>
 #include <eosio/symbol.hpp>
 #include <string>
 #include <vector>
 
+#include "itemmeta.hpp"
+#include "../../common/profile.hpp"
+
 using namespace eosio;
 using std::string;
 using std::vector;
 typedef uint128_t uuid;
 
+// most items one voucher reserves, and so the deepest claim proof
+static constexpr uint32_t max_voucher_items = 1 << 20;
+static constexpr uint32_t max_voucher_depth = 20;
+// most claim bitmap rows one closevouch call erases
+static constexpr uint32_t voucher_close_batch = 256;
+
 
 class [[eosio::contract]] tapxdgoods : public contract {
   public:
   	using contract::contract;
 
+ 	// getowners result per item, owner is the seller while listed, empty if no such item
+ 	struct token_owner {
+ 	    uint64_t serial_number;
+ 	    name     owner;
+ 	    name     token_name;
+ 	    bool     listed;
+
+ 	    EOSLIB_SERIALIZE(token_owner, (serial_number)(owner)(token_name)(listed))
+ 	};
+
     [[eosio::action]]
      void create(name issuer,name token_name, bool fungible, bool
           burnable, bool transferable, uint64_t max_supply);
@@ -25,6 +48,25 @@ class [[eosio::contract]] tapxdgoods : public contract {
     void issue(name to, name token_name, string metadata_type, 
          string metadata_uri, string memo);
 
+ 	// issue with metadata in the itemmeta binary encoding, kept on the item row
+ 	[[eosio::action]]
+ 	void issueitem(name to, name token_name, vector<char> metadata, string memo);
+
+ 	// reserve count serials of token_name for the recipients committed to by root,
+ 	// a Merkle tree over leaves sha256(0x00 || uint32 index || uint64 account), nodes
+ 	// sha256(0x01 || left || right) and zero hashes padding the last node of a level
+ 	[[eosio::action]]
+ 	void createvouch(name token_name, uint32_t count, checksum256 root,
+ 	     string metadata_type, string metadata_uri);
+
+ 	// issue serial first_serial + index of voucher_id to the recipient of leaf index
+ 	[[eosio::action]]
+ 	void claimvouch(name to, uint64_t voucher_id, uint32_t index, vector<checksum256> proof);
+
+ 	// release the unclaimed serials, then free the claim bitmap over as many calls as needed
+ 	[[eosio::action]]
+ 	void closevouch(uint64_t voucher_id);
+
  	[[eosio::action]]
  	void burnnft(name owner, vector<uint64_t> tokeninfo_ids);
 
@@ -32,8 +74,32 @@ class [[eosio::contract]] tapxdgoods : public contract {
  	[[eosio::action]]
  	void transfernft(name from, name to, vector<uint64_t> tokeninfo_ids, string memo);
 
+ 	// escrow items for sale at price, settled in token_contract's brand token
+ 	[[eosio::action]]
+ 	void list(name seller, vector<uint64_t> tokeninfo_ids, name token_contract, asset price);
+
+ 	[[eosio::action]]
+ 	void delist(name seller, vector<uint64_t> tokeninfo_ids);
+
+ 	// a purchase is a token transfer to this contract with memo "buy:<token_name>".
+ 	// It fills the cheapest listing of token_name priced in the transferred token of
+ 	// the notifying contract, pays the seller and refunds any excess to the buyer.
+ 	[[eosio::on_notify("*::transfer")]]
+ 	void onpayment(name from, name to, asset quantity, string memo);
+
+ 	// receipt of a sale, sent inline by onpayment to notify the buyer and seller
+ 	// of the sale instead of re-notifying them of the token transfer
+ 	[[eosio::action]]
+ 	void logsale(name buyer, name seller, uint64_t serial_number, asset price, name token_contract);
+
+ 	// ownership of many items in one read-only call, in the action return value
+ 	[[eosio::action, eosio::read_only]]
+ 	vector<token_owner> getowners(vector<uint64_t> tokeninfo_ids);
 
  private:
+ 	void add_item(name to, name token_name, string metadata_type, string metadata_uri, vector<char>* metadata);
+	uint64_t reserve_serials(uint64_t count);
+
  	struct dasset {
 	    uint64_t amount;
 	    uint8_t  precision; 
@@ -61,11 +127,63 @@ class [[eosio::contract]] tapxdgoods : public contract {
 	    name token_name;
 	    string metadata_type;
 	    string metadata_uri;
+	    binary_extension<vector<char>> metadata;   // itemmeta encoding, issueitem only
 	    
 	    uint64_t primary_key() const { return serial_number; }
 	    uint64_t get_owner() const { return owner.value; }
 	};
 	typedef eosio::multi_index<"tokeninfo"_n,tokeninfo, indexed_by<"byowner"_n, const_mem_fun<tokeninfo, uint64_t, &tokeninfo::get_owner>>> owner_index; 
+
+	// next unused serial, so voucher ranges and issued items never overlap
+	struct [[eosio::table]] serialstate {
+	    uint64_t next_serial = 0;
+	};
+	typedef eosio::singleton<"serials"_n, serialstate> serial_index;
+
+	// serials [first_serial, first_serial + count) reserved for claims, counted in current_supply
+	struct [[eosio::table]] voucher {
+	    uint64_t    first_serial;
+	    name        token_name;
+	    uint32_t    count;
+	    uint32_t    claimed;
+	    bool        closed;
+	    checksum256 root;
+	    string      metadata_type;
+	    string      metadata_uri;
+
+	    uint64_t primary_key() const { return first_serial; }
+	};
+	typedef eosio::multi_index<"vouchers"_n, voucher> voucher_index;
+
+	// claimed leaves index >> 6 .. +63 of a voucher, scoped by its first serial
+	struct [[eosio::table]] voucherclaim {
+	    uint64_t word;
+	    uint64_t bits;
+
+	    uint64_t primary_key() const { return word; }
+	};
+	typedef eosio::multi_index<"vouchclaims"_n, voucherclaim> voucherclaim_index;
+
+	// escrowed sale, the item is owned by the contract while listed
+	struct [[eosio::table]] listing {
+	    uint64_t serial_number;
+	    name     seller;
+	    name     token_name;
+	    name     token_contract;
+	    asset    price;
+
+	    uint64_t primary_key() const { return serial_number; }
+	    checksum256 get_price() const { return price_key(token_name, token_contract, price.symbol, price.amount); }
+	    uint64_t get_seller() const { return seller.value; }
+
+	    // listings of one token_name settled in one token, ordered by price amount
+	    static checksum256 price_key(name token_name, name token_contract, symbol sym, int64_t amount) {
+	        return checksum256::make_from_word_sequence<uint64_t>(token_name.value, token_contract.value, sym.raw(), uint64_t(amount));
+	    }
+	};
+	typedef eosio::multi_index<"listings"_n, listing,
+	    indexed_by<"byprice"_n, const_mem_fun<listing, checksum256, &listing::get_price>>,
+	    indexed_by<"byseller"_n, const_mem_fun<listing, uint64_t, &listing::get_seller>>> listing_index;
   
 };
 
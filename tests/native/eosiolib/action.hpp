@@ -0,0 +1,39 @@
+/**
+ *  action.hpp
+ *  copyright TAPx.io
+ *
+ *  Inline actions are recorded in the host trace, not executed.
+ */
+#pragma once
+
+#include "types.hpp"
+
+namespace shim {
+
+   void record_inline( account_name code, action_name act );
+
+} /// namespace shim
+
+namespace eosio {
+
+   struct permission_level {
+      permission_level( account_name a, permission_name p ) : actor( a ), permission( p ) {}
+      permission_level() {}
+
+      account_name    actor = 0;
+      permission_name permission = 0;
+   };
+
+   struct action {
+      account_name  account = 0;
+      action_name   name = 0;
+
+      template<typename T>
+      action( const permission_level&, account_name code, action_name act, T&& ) : account( code ), name( act ) {}
+
+      void send()const { shim::record_inline( account, name ); }
+   };
+
+} /// namespace eosio
+
+#define SEND_INLINE_ACTION( CONTRACT, NAME, ... ) ::shim::record_inline( (CONTRACT).get_self(), N(NAME) )
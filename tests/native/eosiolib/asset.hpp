@@ -0,0 +1,67 @@
+/**
+ *  asset.hpp
+ *  copyright TAPx.io
+ */
+#pragma once
+
+#include "symbol.hpp"
+
+namespace eosio {
+
+   struct asset {
+      static constexpr int64_t max_amount = (1LL << 62) - 1;
+
+      int64_t      amount;
+      symbol_type  symbol;
+
+      explicit asset( int64_t a = 0, symbol_type s = S(4,SYS) ) : amount( a ), symbol( s ) {
+         eosio_assert( is_amount_within_range(), "magnitude of asset amount must be less than 2^62" );
+         eosio_assert( symbol.is_valid(), "invalid symbol name" );
+      }
+
+      bool is_amount_within_range()const { return -max_amount <= amount && amount <= max_amount; }
+      bool is_valid()const { return is_amount_within_range() && symbol.is_valid(); }
+
+      asset operator-()const { return asset( -amount, symbol ); }
+
+      asset& operator-=( const asset& a ) {
+         eosio_assert( a.symbol == symbol, "attempt to subtract asset with different symbol" );
+         amount -= a.amount;
+         eosio_assert( -max_amount <= amount, "subtraction underflow" );
+         eosio_assert( amount <= max_amount, "subtraction overflow" );
+         return *this;
+      }
+      asset& operator+=( const asset& a ) {
+         eosio_assert( a.symbol == symbol, "attempt to add asset with different symbol" );
+         amount += a.amount;
+         eosio_assert( -max_amount <= amount, "addition underflow" );
+         eosio_assert( amount <= max_amount, "addition overflow" );
+         return *this;
+      }
+      friend asset operator+( const asset& a, const asset& b ) { asset r = a; r += b; return r; }
+      friend asset operator-( const asset& a, const asset& b ) { asset r = a; r -= b; return r; }
+
+      friend bool operator==( const asset& a, const asset& b ) {
+         eosio_assert( a.symbol == b.symbol, "comparison of assets with different symbols is not allowed" );
+         return a.amount == b.amount;
+      }
+      friend bool operator!=( const asset& a, const asset& b ) { return !(a == b); }
+      friend bool operator<( const asset& a, const asset& b ) {
+         eosio_assert( a.symbol == b.symbol, "comparison of assets with different symbols is not allowed" );
+         return a.amount < b.amount;
+      }
+      friend bool operator<=( const asset& a, const asset& b ) { return !(b < a); }
+      friend bool operator>( const asset& a, const asset& b ) { return b < a; }
+      friend bool operator>=( const asset& a, const asset& b ) { return !(a < b); }
+
+      std::string to_string()const {
+         uint32_t p = symbol.precision();
+         int64_t mag = amount < 0 ? -amount : amount;
+         int64_t unit = 1;
+         for( uint32_t i = 0; i < p; ++i ) unit *= 10;
+         std::string frac = std::to_string( mag % unit + unit ).substr( 1 );
+         return (amount < 0 ? "-" : "") + std::to_string( mag / unit ) + (p ? "." + frac : "") + " " + symbol.code();
+      }
+   };
+
+} /// namespace eosio
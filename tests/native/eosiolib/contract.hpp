@@ -0,0 +1,20 @@
+/**
+ *  contract.hpp
+ *  copyright TAPx.io
+ */
+#pragma once
+
+#include "types.hpp"
+
+namespace eosio {
+
+   class contract {
+      public:
+         contract( account_name n ) : _self( n ) {}
+         account_name get_self()const { return _self; }
+
+      protected:
+         account_name _self;
+   };
+
+} /// namespace eosio
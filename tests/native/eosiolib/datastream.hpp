@@ -0,0 +1,38 @@
+/**
+ *  datastream.hpp
+ *  copyright TAPx.io
+ *
+ *  Action return values are not serialized, pack() hands the value itself
+ *  to the host, where a test reads it back with shim::returned<T>().
+ */
+#pragma once
+
+#include "types.hpp"
+
+namespace shim {
+
+   void set_returned( std::shared_ptr<void> value );
+
+} /// namespace shim
+
+namespace eosio {
+
+   template<typename T>
+   std::vector<char> pack( const T& value ) {
+      shim::set_returned( std::make_shared<T>( value ) );
+      return {};
+   }
+
+} /// namespace eosio
+
+#define SHIM_SEQ_CAT_( a, b ) a##b
+#define SHIM_SEQ_CAT( a, b ) SHIM_SEQ_CAT_( a, b )
+#define SHIM_SEQ_FIELD( f ) v( #f, t.f );
+#define SHIM_SEQ_A( f ) SHIM_SEQ_FIELD( f ) SHIM_SEQ_B
+#define SHIM_SEQ_B( f ) SHIM_SEQ_FIELD( f ) SHIM_SEQ_A
+#define SHIM_SEQ_A_END
+#define SHIM_SEQ_B_END
+
+//field reflection instead of serialization, tests print and compare rows with it
+#define EOSLIB_SERIALIZE( TYPE, MEMBERS ) \
+   template<typename V> friend void shim_reflect( const TYPE& t, V&& v ) { SHIM_SEQ_CAT( SHIM_SEQ_A MEMBERS, _END ) }
@@ -0,0 +1,16 @@
+/**
+ *  eosio.hpp
+ *  copyright TAPx.io
+ */
+#pragma once
+
+#include "action.hpp"
+#include "asset.hpp"
+#include "contract.hpp"
+#include "datastream.hpp"
+#include "multi_index.hpp"
+#include "print.hpp"
+#include "types.hpp"
+
+//tests call the action methods directly
+#define EOSIO_ABI( TYPE, MEMBERS )
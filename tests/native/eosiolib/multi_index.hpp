@@ -0,0 +1,346 @@
+/**
+ *  multi_index.hpp
+ *  copyright TAPx.io
+ *
+ *  In-memory multi_index. Rows of each (code, scope, table) are kept in a
+ *  host table ordered by primary key, with their RAM payer. As on chain,
+ *  the payer must be the receiver or an account that authorized the action.
+ *  Secondary indices are computed from the rows on every lookup, which is slow but
+ *  keeps iterators valid across modify and erase like the chain's.
+ *  Iterators carry (code, scope) rather than a pointer to the table object,
+ *  so they outlive temporaries such as `ledgers( _self, sym ).find( id )`.
+ *  Every lookup or iterator step counts as one db read and every emplace,
+ *  modify or erase as one db write, the unit -DTAPX_PROFILE counts in.
+ */
+#pragma once
+
+#include "types.hpp"
+
+#include <algorithm>
+#include <ostream>
+
+namespace shim {
+
+   struct table_base {
+      virtual ~table_base() {}
+      virtual std::unique_ptr<table_base> clone()const = 0;
+      virtual bool empty()const = 0;
+      virtual void dump( std::ostream& out, const std::string& prefix )const = 0;
+   };
+
+   table_base*& table_slot( uint64_t code, uint64_t scope, uint64_t table );
+
+   //chain database calls of the running action, checked against TAPX_PROFILE counts
+   void count_db_read();
+   void count_db_write();
+
+   template<typename T> void print_row( std::ostream& out, const T& row );
+
+   template<typename T>
+   struct table_data : table_base {
+      struct entry {
+         T        row;
+         uint64_t payer;
+      };
+      std::map<uint64_t, entry> rows;
+
+      std::unique_ptr<table_base> clone()const override { return std::unique_ptr<table_base>( new table_data( *this ) ); }
+      bool empty()const override { return rows.empty(); }
+      void dump( std::ostream& out, const std::string& prefix )const override {
+         for( const auto& r : rows ) {
+            out << prefix << " " << r.first << " payer=" << eosio::name_to_string( r.second.payer ) << " ";
+            print_row( out, r.second.row );
+            out << "\n";
+         }
+      }
+   };
+
+} /// namespace shim
+
+namespace eosio {
+
+   template<typename Class, typename Type, Type (Class::*PtrToMemberFunction)()const>
+   struct const_mem_fun {
+      typedef Type result_type;
+      Type operator()( const Class& c )const { return (c.*PtrToMemberFunction)(); }
+   };
+
+   template<uint64_t IndexName, typename Extractor>
+   struct indexed_by {
+      enum constants { index_name = IndexName };
+      typedef Extractor secondary_extractor_type;
+   };
+
+   template<uint64_t TableName, typename T, typename... Indices>
+   class multi_index {
+      public:
+         struct const_iterator {
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef T value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const T* pointer;
+            typedef const T& reference;
+
+            uint64_t code = 0;
+            uint64_t scope = 0;
+            uint64_t pk = 0;
+            bool     at_end = true;
+
+            const T& operator*()const {
+               auto& rows = data_of( code, scope ).rows;
+               auto it = rows.find( pk );
+               eosio_assert( it != rows.end(), "dereference of erased row" );
+               return it->second.row;
+            }
+            const T* operator->()const { return &**this; }
+
+            const_iterator& operator++() {
+               shim::count_db_read();
+               auto& rows = data_of( code, scope ).rows;
+               auto it = rows.upper_bound( pk );
+               at_end = it == rows.end();
+               if( !at_end ) pk = it->first;
+               return *this;
+            }
+            const_iterator& operator--() {
+               shim::count_db_read();
+               auto& rows = data_of( code, scope ).rows;
+               auto it = at_end ? rows.end() : rows.lower_bound( pk );
+               eosio_assert( it != rows.begin(), "cannot decrement iterator at beginning of table" );
+               --it;
+               pk = it->first;
+               at_end = false;
+               return *this;
+            }
+            const_iterator operator++( int ) { auto t = *this; ++*this; return t; }
+            const_iterator operator--( int ) { auto t = *this; --*this; return t; }
+
+            bool operator==( const const_iterator& o )const { return at_end == o.at_end && (at_end || pk == o.pk); }
+            bool operator!=( const const_iterator& o )const { return !(*this == o); }
+         };
+         typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+         template<typename Extractor>
+         class index {
+            public:
+               typedef typename std::decay<typename Extractor::result_type>::type key_type;
+
+               struct const_iterator {
+                  typedef std::bidirectional_iterator_tag iterator_category;
+                  typedef T value_type;
+                  typedef std::ptrdiff_t difference_type;
+                  typedef const T* pointer;
+                  typedef const T& reference;
+
+                  uint64_t code = 0;
+                  uint64_t scope = 0;
+                  key_type key{};
+                  uint64_t pk = 0;
+                  bool     at_end = true;
+
+                  const T& operator*()const {
+                     auto& rows = data_of( code, scope ).rows;
+                     auto it = rows.find( pk );
+                     eosio_assert( it != rows.end(), "dereference of erased row" );
+                     return it->second.row;
+                  }
+                  const T* operator->()const { return &**this; }
+
+                  const_iterator& operator++() {
+                     shim::count_db_read();
+                     auto keys = sorted( code, scope );
+                     *this = at( code, scope, keys, std::upper_bound( keys.begin(), keys.end(), std::make_pair( key, pk ) ) );
+                     return *this;
+                  }
+                  const_iterator& operator--() {
+                     shim::count_db_read();
+                     auto keys = sorted( code, scope );
+                     auto it = at_end ? keys.end() : std::lower_bound( keys.begin(), keys.end(), std::make_pair( key, pk ) );
+                     eosio_assert( it != keys.begin(), "cannot decrement iterator at beginning of index" );
+                     *this = at( code, scope, keys, --it );
+                     return *this;
+                  }
+                  const_iterator operator++( int ) { auto t = *this; ++*this; return t; }
+                  const_iterator operator--( int ) { auto t = *this; --*this; return t; }
+
+                  bool operator==( const const_iterator& o )const { return at_end == o.at_end && (at_end || (key == o.key && pk == o.pk)); }
+                  bool operator!=( const const_iterator& o )const { return !(*this == o); }
+               };
+               typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+               index( uint64_t code, uint64_t scope ) : _code( code ), _scope( scope ) {}
+
+               const_iterator begin()const { shim::count_db_read(); auto keys = sorted( _code, _scope ); return at( _code, _scope, keys, keys.begin() ); }
+               const_iterator end()const { const_iterator e; e.code = _code; e.scope = _scope; return e; }
+               const_reverse_iterator rbegin()const { return const_reverse_iterator( end() ); }
+               const_reverse_iterator rend()const { return const_reverse_iterator( begin() ); }
+
+               const_iterator lower_bound( const key_type& k )const {
+                  shim::count_db_read();
+                  auto keys = sorted( _code, _scope );
+                  return at( _code, _scope, keys, std::lower_bound( keys.begin(), keys.end(), std::make_pair( k, uint64_t( 0 ) ) ) );
+               }
+               const_iterator upper_bound( const key_type& k )const {
+                  shim::count_db_read();
+                  auto keys = sorted( _code, _scope );
+                  return at( _code, _scope, keys, std::upper_bound( keys.begin(), keys.end(), std::make_pair( k, ~uint64_t( 0 ) ) ) );
+               }
+               const_iterator find( const key_type& k )const {
+                  auto it = lower_bound( k );
+                  return it != end() && it.key == k ? it : end();
+               }
+               const T& get( const key_type& k, const char* msg = "unable to find secondary key" )const {
+                  auto it = find( k );
+                  eosio_assert( it != end(), msg );
+                  return *it;
+               }
+
+               template<typename Lambda>
+               void modify( const_iterator it, uint64_t payer, Lambda&& updater ) {
+                  multi_index( _code, _scope ).modify( *it, payer, std::forward<Lambda>( updater ) );
+               }
+               const_iterator erase( const_iterator it ) {
+                  eosio_assert( it != end(), "cannot pass end iterator to erase" );
+                  auto next = it;
+                  ++next;
+                  multi_index( _code, _scope ).erase( *it );
+                  return next;
+               }
+
+            private:
+               typedef std::vector<std::pair<key_type, uint64_t>> key_list;
+
+               static key_list sorted( uint64_t code, uint64_t scope ) {
+                  key_list keys;
+                  for( const auto& r : data_of( code, scope ).rows ) keys.emplace_back( Extractor()( r.second.row ), r.first );
+                  std::sort( keys.begin(), keys.end() );
+                  return keys;
+               }
+               static const_iterator at( uint64_t code, uint64_t scope, const key_list& keys, typename key_list::const_iterator it ) {
+                  const_iterator c;
+                  c.code = code;
+                  c.scope = scope;
+                  if( it == keys.end() ) return c;
+                  c.key = it->first;
+                  c.pk = it->second;
+                  c.at_end = false;
+                  return c;
+               }
+
+               uint64_t _code;
+               uint64_t _scope;
+         };
+
+         multi_index( uint64_t code, uint64_t scope ) : _code( code ), _scope( scope ) {}
+
+         uint64_t get_code()const { return _code; }
+         uint64_t get_scope()const { return _scope; }
+
+         const_iterator begin()const { shim::count_db_read(); return at( data().rows.begin() ); }
+         const_iterator end()const { const_iterator e; e.code = _code; e.scope = _scope; return e; }
+         const_reverse_iterator rbegin()const { return const_reverse_iterator( end() ); }
+         const_reverse_iterator rend()const { return const_reverse_iterator( begin() ); }
+
+         const_iterator find( uint64_t pk )const { shim::count_db_read(); return at( data().rows.find( pk ) ); }
+         const_iterator lower_bound( uint64_t pk )const { shim::count_db_read(); return at( data().rows.lower_bound( pk ) ); }
+         const_iterator upper_bound( uint64_t pk )const { shim::count_db_read(); return at( data().rows.upper_bound( pk ) ); }
+         const T& get( uint64_t pk, const char* msg = "unable to find key" )const {
+            shim::count_db_read();
+            auto it = data().rows.find( pk );
+            eosio_assert( it != data().rows.end(), msg );
+            return it->second.row;
+         }
+         const_iterator iterator_to( const T& obj )const { return at( data().rows.find( obj.primary_key() ) ); }
+
+         uint64_t available_primary_key()const {
+            shim::count_db_read();
+            return data().rows.empty() ? 0 : data().rows.rbegin()->first + 1;
+         }
+
+         template<typename Lambda>
+         const_iterator emplace( uint64_t payer, Lambda&& constructor ) {
+            eosio_assert( _code == current_receiver(), "cannot create objects in table of another contract" );
+            eosio_assert( payer != 0, "must specify a valid account to pay for new record" );
+            eosio_assert( payer == current_receiver() || has_auth( payer ), "cannot bill RAM to an account that did not authorize the action" );
+            T row = T();
+            constructor( row );
+            uint64_t pk = row.primary_key();
+            auto& rows = data().rows;
+            eosio_assert( rows.find( pk ) == rows.end(), "could not insert object, most likely a uniqueness constraint was violated" );
+            rows.emplace( pk, typename shim::table_data<T>::entry{ row, payer } );
+            shim::count_db_write();
+            return at( rows.find( pk ) );
+         }
+
+         template<typename Lambda>
+         void modify( const T& obj, uint64_t payer, Lambda&& updater ) {
+            eosio_assert( _code == current_receiver(), "cannot modify objects in table of another contract" );
+            uint64_t pk = obj.primary_key();
+            auto it = data().rows.find( pk );
+            eosio_assert( it != data().rows.end(), "object passed to modify is not in multi_index" );
+            eosio_assert( !payer || payer == current_receiver() || has_auth( payer ), "cannot bill RAM to an account that did not authorize the action" );
+            T row = it->second.row;
+            updater( row );
+            eosio_assert( row.primary_key() == pk, "updater cannot change primary key when modifying an object" );
+            it->second.row = row;
+            if( payer ) it->second.payer = payer;
+            shim::count_db_write();
+         }
+         template<typename Lambda>
+         void modify( const_iterator it, uint64_t payer, Lambda&& updater ) {
+            eosio_assert( it != end(), "cannot pass end iterator to modify" );
+            modify( *it, payer, std::forward<Lambda>( updater ) );
+         }
+
+         const_iterator erase( const_iterator it ) {
+            eosio_assert( it != end(), "cannot pass end iterator to erase" );
+            auto next = it;
+            ++next;
+            erase( *it );
+            return next;
+         }
+         void erase( const T& obj ) {
+            eosio_assert( _code == current_receiver(), "cannot erase objects in table of another contract" );
+            eosio_assert( data().rows.erase( obj.primary_key() ) == 1, "object passed to erase is not in multi_index" );
+            shim::count_db_write();
+         }
+
+         template<uint64_t IndexName>
+         auto get_index()const {
+            return get_index_impl<IndexName, Indices...>();
+         }
+
+         shim::table_data<T>& data()const { return data_of( _code, _scope ); }
+
+         static shim::table_data<T>& data_of( uint64_t code, uint64_t scope ) {
+            shim::table_base*& slot = shim::table_slot( code, scope, TableName );
+            if( !slot ) slot = new shim::table_data<T>();
+            return static_cast<shim::table_data<T>&>( *slot );
+         }
+
+      private:
+         template<uint64_t IN, typename I, typename... Rest>
+         auto get_index_impl()const {
+            if constexpr( I::index_name == IN ) {
+               return index<typename I::secondary_extractor_type>( _code, _scope );
+            } else {
+               static_assert( sizeof...(Rest) > 0, "no such index" );
+               return get_index_impl<IN, Rest...>();
+            }
+         }
+
+         const_iterator at( typename std::map<uint64_t, typename shim::table_data<T>::entry>::const_iterator it )const {
+            const_iterator c;
+            c.code = _code;
+            c.scope = _scope;
+            if( it == data().rows.end() ) return c;
+            c.pk = it->first;
+            c.at_end = false;
+            return c;
+         }
+
+         uint64_t _code;
+         uint64_t _scope;
+   };
+
+} /// namespace eosio
@@ -0,0 +1,12 @@
+/**
+ *  print.hpp
+ *  copyright TAPx.io
+ */
+#pragma once
+
+#include "types.hpp"
+
+extern "C" {
+   void prints_l( const char* cstr, uint32_t len );
+   void printui( uint64_t value );
+}
@@ -0,0 +1,47 @@
+/**
+ *  symbol.hpp
+ *  copyright TAPx.io
+ */
+#pragma once
+
+#include "types.hpp"
+
+namespace eosio {
+
+   struct symbol_type {
+      symbol_name value = 0;
+
+      symbol_type() {}
+      symbol_type( symbol_name s ) : value( s ) {}
+
+      bool is_valid()const {
+         uint64_t sym = value >> 8;
+         for( int i = 0; i < 7; ++i ) {
+            char c = char( sym & 0xff );
+            if( !('A' <= c && c <= 'Z') ) return false;
+            sym >>= 8;
+            if( !(sym & 0xff) ) {
+               do {
+                  sym >>= 8;
+                  if( sym & 0xff ) return false;
+                  ++i;
+               } while( i < 7 );
+            }
+         }
+         return true;
+      }
+      uint32_t precision()const { return uint32_t( value & 0xff ); }
+      symbol_name name()const { return value >> 8; }
+      operator symbol_name()const { return value; }
+
+      std::string code()const {
+         std::string s;
+         for( uint64_t sym = value >> 8; sym & 0xff; sym >>= 8 ) s += char( sym & 0xff );
+         return s;
+      }
+
+      friend bool operator==( const symbol_type& a, const symbol_type& b ) { return a.value == b.value; }
+      friend bool operator!=( const symbol_type& a, const symbol_type& b ) { return a.value != b.value; }
+   };
+
+} /// namespace eosio
@@ -0,0 +1,84 @@
+/**
+ *  types.hpp
+ *  copyright TAPx.io
+ *
+ *  Native host shim of the eosiolib headers the contracts include, so their
+ *  sources compile and run as ordinary C++ in tests/native. Tables live in
+ *  memory (multi_index.hpp) and the intrinsics are defined by host.hpp.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+typedef uint64_t account_name;
+typedef uint64_t symbol_name;
+typedef uint64_t table_name;
+typedef uint64_t action_name;
+typedef uint64_t permission_name;
+typedef uint64_t scope_name;
+typedef unsigned __int128 uint128_t;
+typedef __int128 int128_t;
+
+extern "C" {
+   void eosio_assert( uint32_t test, const char* msg );
+   void require_auth( account_name name );
+   bool has_auth( account_name name );
+   bool is_account( account_name name );
+   void require_recipient( account_name name );
+   uint32_t now();
+   uint64_t current_time();
+   account_name current_receiver();
+}
+
+namespace eosio {
+
+   static constexpr char char_to_symbol( char c ) {
+      if( c >= 'a' && c <= 'z' ) return (c - 'a') + 6;
+      if( c >= '1' && c <= '5' ) return (c - '1') + 1;
+      return 0;
+   }
+
+   static constexpr uint64_t string_to_name( const char* str ) {
+      uint64_t name = 0;
+      int i = 0;
+      for( ; str[i] && i < 12; ++i ) name |= (uint64_t( char_to_symbol( str[i] ) ) & 0x1f) << (64 - 5 * (i + 1));
+      if( i == 12 ) name |= uint64_t( char_to_symbol( str[12] ) ) & 0x0f;
+      return name;
+   }
+
+   inline std::string name_to_string( uint64_t value ) {
+      static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+      std::string str( 13, '.' );
+      uint64_t tmp = value;
+      for( uint32_t i = 0; i <= 12; ++i ) {
+         char c = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
+         str[12 - i] = c;
+         tmp >>= (i == 0 ? 4 : 5);
+      }
+      size_t last = str.find_last_not_of( '.' );
+      return last == std::string::npos ? std::string() : str.substr( 0, last + 1 );
+   }
+
+   static constexpr uint64_t string_to_symbol( uint8_t precision, const char* str ) {
+      uint32_t len = 0;
+      while( str[len] ) ++len;
+      uint64_t result = 0;
+      for( uint32_t i = 0; i < len; ++i ) result |= uint64_t( str[i] ) << (8 * (1 + i));
+      return result | uint64_t( precision );
+   }
+
+} /// namespace eosio
+
+#define N(X) ::eosio::string_to_name(#X)
+#define S(P,X) ::eosio::string_to_symbol(P,#X)
@@ -0,0 +1,248 @@
+/**
+ *  host.hpp
+ *  copyright TAPx.io
+ *
+ *  Host side of the native eosiolib shim: chain intrinsics, the in-memory
+ *  database and a runner that applies one action with rollback on assert.
+ *  Include it in exactly one translation unit, after the contract sources.
+ */
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace shim {
+
+   struct assert_failure : std::runtime_error {
+      using std::runtime_error::runtime_error;
+   };
+
+   typedef std::tuple<uint64_t, uint64_t, uint64_t> table_key;
+
+   struct db_counts {
+      uint32_t reads = 0;
+      uint32_t writes = 0;
+
+      bool operator!=( const db_counts& o )const { return reads != o.reads || writes != o.writes; }
+   };
+
+   //tables of every contract, owning and deep copied so a failed action can be undone
+   struct database {
+      std::map<table_key, table_base*> tables;
+
+      database() {}
+      database( const database& o ) { for( const auto& t : o.tables ) tables[t.first] = t.second ? t.second->clone().release() : nullptr; }
+      database& operator=( database o ) { std::swap( tables, o.tables ); return *this; }
+      ~database() { for( auto& t : tables ) delete t.second; }
+   };
+
+   struct chain {
+      database                   db;
+      account_name               receiver = 0;
+      uint32_t                   time = 1600000000;
+      std::set<account_name>     auths;
+      std::set<account_name>     accounts;
+      std::vector<std::string>   trace;
+      std::shared_ptr<void>      returned;
+      std::map<std::string, db_counts> calls;   // database calls made, by profile section path
+      std::string                console;
+   };
+
+   inline chain& state() {
+      static chain c;
+      return c;
+   }
+
+   inline table_base*& table_slot( uint64_t code, uint64_t scope, uint64_t table ) {
+      return state().db.tables[table_key( code, scope, table )];
+   }
+
+   //path of the innermost open profile section, as its PROF line prints it
+   inline std::string section_path() {
+      std::string path;
+#ifdef TAPX_PROFILE
+      for( auto* s = eosio::profile::section::current(); s; s = s->parent ) {
+         path = path.empty() ? std::string( s->label ) : std::string( s->label ) + ";" + path;
+      }
+#endif
+      return path;
+   }
+
+   inline void count_db_read() { ++state().calls[section_path()].reads; }
+   inline void count_db_write() { ++state().calls[section_path()].writes; }
+
+   inline void set_returned( std::shared_ptr<void> value ) { state().returned = value; }
+
+   template<typename T>
+   const T& returned() {
+      eosio_assert( state().returned != nullptr, "action returned no value" );
+      return *static_cast<const T*>( state().returned.get() );
+   }
+
+   inline void record_inline( account_name code, action_name act ) {
+      state().trace.push_back( "inline " + eosio::name_to_string( code ) + "::" + eosio::name_to_string( act ) );
+   }
+
+   struct outcome {
+      bool                       ok = true;
+      std::string                error;
+      std::vector<std::string>   trace;
+      std::map<std::string, db_counts> made;       // database calls, by section path
+      std::map<std::string, db_counts> profiled;   // the PROF lines' counts, by section path
+   };
+
+   //Add up the db read and write columns of the PROF lines printed by a -DTAPX_PROFILE build
+   inline std::map<std::string, db_counts> sum_profile( const std::string& console ) {
+      std::map<std::string, db_counts> counts;
+      std::istringstream in( console );
+      std::string line;
+      while( std::getline( in, line ) ) {
+         if( line.compare( 0, 5, "PROF " ) != 0 ) continue;
+         std::istringstream fields( line.substr( 5 ) );
+         std::string path;
+         uint32_t r = 0, w = 0;
+         fields >> path >> r >> w;
+         counts[path].reads += r;
+         counts[path].writes += w;
+      }
+      return counts;
+   }
+
+   /**
+    * Apply one action as receiver with the given authorizations. On an assert
+    * the database and trace are restored to their state before the action,
+    * as the chain would.
+    */
+   template<typename Lambda>
+   outcome run( account_name receiver, std::initializer_list<account_name> auths, Lambda&& apply ) {
+      chain& c = state();
+      database saved = c.db;
+      c.receiver = receiver;
+      c.auths = auths;
+      c.trace.clear();
+      c.returned.reset();
+      c.calls.clear();
+      c.console.clear();
+      outcome out;
+      try {
+         apply();
+      } catch( const assert_failure& e ) {
+         out.ok = false;
+         out.error = e.what();
+         c.db = saved;
+         c.trace.clear();
+      }
+      out.trace = c.trace;
+      out.made = c.calls;
+      out.profiled = sum_profile( c.console );
+      return out;
+   }
+
+   //field printers for table dumps
+   inline void print_value( std::ostream& out, uint64_t v ) { out << v; }
+   inline void print_value( std::ostream& out, int64_t v ) { out << v; }
+   inline void print_value( std::ostream& out, uint32_t v ) { out << v; }
+   inline void print_value( std::ostream& out, int32_t v ) { out << v; }
+   inline void print_value( std::ostream& out, uint16_t v ) { out << v; }
+   inline void print_value( std::ostream& out, uint8_t v ) { out << uint32_t( v ); }
+   inline void print_value( std::ostream& out, bool v ) { out << (v ? "true" : "false"); }
+   inline void print_value( std::ostream& out, const std::string& v ) { out << '"' << v << '"'; }
+   inline void print_value( std::ostream& out, const eosio::asset& v ) { out << '"' << v.to_string() << '"'; }
+   inline void print_value( std::ostream& out, const eosio::symbol_type& v ) { out << v.precision() << "," << v.code(); }
+   inline void print_value( std::ostream& out, uint128_t v ) {
+      out << "0x" << std::hex << uint64_t( v >> 64 ) << ":" << uint64_t( v ) << std::dec;
+   }
+   template<typename T>
+   void print_value( std::ostream& out, const std::vector<T>& v ) {
+      out << "[";
+      for( size_t i = 0; i < v.size(); ++i ) {
+         if( i ) out << ",";
+         print_value( out, v[i] );
+      }
+      out << "]";
+   }
+   template<typename T>
+   auto print_value( std::ostream& out, const T& v ) -> decltype( shim_reflect( v, std::declval<void(*)( const char*, int )>() ), void() ) {
+      print_row( out, v );
+   }
+
+   template<typename T>
+   auto reflect_row( std::ostream& out, const T& row, int ) -> decltype( shim_reflect( row, std::declval<void(*)( const char*, int )>() ), void() ) {
+      bool first = true;
+      shim_reflect( row, [&]( const char* field, const auto& value ) {
+         out << (first ? "{" : ",") << field << ":";
+         print_value( out, value );
+         first = false;
+      } );
+      out << "}";
+   }
+
+   //the token tables declare no serialization, print their known fields
+   template<typename T>
+   auto reflect_row( std::ostream& out, const T& row, long ) -> decltype( row.balance, void() ) {
+      out << "{balance:";
+      print_value( out, row.balance );
+      out << "}";
+   }
+   template<typename T>
+   auto reflect_row( std::ostream& out, const T& row, long ) -> decltype( row.max_supply, void() ) {
+      out << "{supply:";
+      print_value( out, row.supply );
+      out << ",max_supply:";
+      print_value( out, row.max_supply );
+      out << ",issuer:" << eosio::name_to_string( row.issuer ) << "}";
+   }
+
+   template<typename T>
+   void print_row( std::ostream& out, const T& row ) { reflect_row( out, row, 0 ); }
+
+   //every non-empty table, in (code, scope, table) order
+   inline std::string dump() {
+      std::ostringstream out;
+      for( const auto& t : state().db.tables ) {
+         if( !t.second || t.second->empty() ) continue;
+         std::string prefix = eosio::name_to_string( std::get<0>( t.first ) ) + " " +
+                              std::to_string( std::get<1>( t.first ) ) + " " +
+                              eosio::name_to_string( std::get<2>( t.first ) );
+         t.second->dump( out, prefix );
+      }
+      return out.str();
+   }
+
+} /// namespace shim
+
+extern "C" {
+
+   void eosio_assert( uint32_t test, const char* msg ) {
+      if( !test ) throw shim::assert_failure( msg );
+   }
+
+   void require_auth( account_name name ) {
+      eosio_assert( shim::state().auths.count( name ), ("missing authority of " + eosio::name_to_string( name )).c_str() );
+   }
+
+   bool has_auth( account_name name ) { return shim::state().auths.count( name ); }
+
+   bool is_account( account_name name ) { return shim::state().accounts.count( name ); }
+
+   void require_recipient( account_name name ) {
+      shim::state().trace.push_back( "notify " + eosio::name_to_string( name ) );
+   }
+
+   uint32_t now() { return shim::state().time; }
+
+   uint64_t current_time() { return uint64_t( shim::state().time ) * 1000000; }
+
+   account_name current_receiver() { return shim::state().receiver; }
+
+   void prints_l( const char* cstr, uint32_t len ) { shim::state().console.append( cstr, len ); }
+
+   void printui( uint64_t value ) { shim::state().console += std::to_string( value ); }
+
+   void set_action_return_value( void*, size_t ) {}
+
+}
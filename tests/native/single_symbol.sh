@@ -0,0 +1,49 @@
+#!/bin/sh
+# Build the native scenario generic and single-symbol, and compare the outputs.
+# A -DTAPX_PROFILE build must match too: it only prints the sections whose
+# profile counts differ from the database calls the shim saw. The generic
+# output must equal the checked-in single_symbol.expected; after a deliberate
+# behaviour change, review the diff and rerun with -u to rewrite it.
+# usage: tests/native/single_symbol.sh [-v|-u]
+set -e
+root=$(cd "$(dirname "$0")/../.." && pwd)
+out=${TMPDIR:-/tmp}/tapx-single-symbol
+mkdir -p "$out"
+
+CXX=${CXX:-g++}
+CXXFLAGS="-std=c++17 -O1 -Wall -Wno-unused -Wno-attributes -I$root/tests/native"
+
+$CXX $CXXFLAGS "$root/tests/native/single_symbol.cpp" -o "$out/generic"
+$CXX $CXXFLAGS -DTAPX_SINGLE_SYMBOL -DBRANDEDTOKEN_SINGLE_SYMBOL='S(4,GDP)' \
+   "$root/tests/native/single_symbol.cpp" -o "$out/single"
+$CXX $CXXFLAGS -DTAPX_PROFILE "$root/tests/native/single_symbol.cpp" -o "$out/profile"
+
+"$out/generic" > "$out/generic.txt"
+"$out/single" > "$out/single.txt"
+"$out/profile" > "$out/profile.txt"
+
+expected="$root/tests/native/single_symbol.expected"
+if [ "$1" = "-u" ]; then
+   cp "$out/generic.txt" "$expected"
+fi
+if diff -u "$expected" "$out/generic.txt"; then
+   echo "generic build matches single_symbol.expected"
+else
+   echo "generic build differs from single_symbol.expected" >&2
+   exit 1
+fi
+if diff -u "$out/generic.txt" "$out/single.txt"; then
+   echo "single-symbol build matches generic build: $(grep -c ': ' "$out/generic.txt") actions, $(sed -n '/^tables$/,$p' "$out/generic.txt" | tail -n +2 | wc -l) rows"
+else
+   echo "single-symbol build differs from generic build" >&2
+   exit 1
+fi
+if diff -u "$out/generic.txt" "$out/profile.txt"; then
+   echo "profile build counts every database call"
+else
+   echo "profile build miscounts database calls" >&2
+   exit 1
+fi
+if [ "$1" = "-v" ]; then
+   "$out/generic" -v
+fi
@@ -0,0 +1,287 @@
+/**
+ *  tabledump.hpp
+ *  copyright TAPx.io
+ *
+ *  Reader for contract table dumps: one JSON row per line, as exported from
+ *  a nodeos snapshot or state history, e.g.
+ *
+ *    {"code":"tapatalktpx1","table":"accounts","scope":"alice","primary_key":"...","value":{"balance":"1.0000 TAP"}}
+ *
+ *  Nested objects are flattened into dotted keys ("value.balance") so the
+ *  tools can look fields up without a JSON library.
+ */
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tapx {
+
+   using std::string;
+
+   struct dump_row {
+      std::vector<std::pair<string, string>> fields;
+      std::vector<bool>                      literal;   //per field, value was an unquoted number, bool or null
+
+      const string* find( const char* key )const {
+         for( const auto& f : fields ) {
+            if( f.first == key ) return &f.second;
+         }
+         return nullptr;
+      }
+
+      const string& get( const char* key )const {
+         static const string empty;
+         const string* v = find( key );
+         return v ? *v : empty;
+      }
+
+      const string& code()const  { return get( "code" ); }
+      const string& table()const { return get( "table" ); }
+      const string& scope()const { return get( "scope" ); }
+   };
+
+   //asset string "12.3456 TAP"
+   struct dump_asset {
+      int64_t   amount = 0;
+      uint8_t   precision = 0;
+      string    symbol;
+
+      bool same_symbol( const dump_asset& o )const {
+         return precision == o.precision && symbol == o.symbol;
+      }
+
+      string to_string()const {
+         string digits = std::to_string( amount < 0 ? -amount : amount );
+         if( precision > 0 ) {
+            if( digits.size() <= precision ) digits.insert( 0, precision + 1 - digits.size(), '0' );
+            digits.insert( digits.size() - precision, "." );
+         }
+         return (amount < 0 ? "-" : "") + digits + " " + symbol;
+      }
+   };
+
+   inline bool parse_asset( const string& s, dump_asset& out ) {
+      size_t i = 0;
+      bool neg = false;
+      if( i < s.size() && s[i] == '-' ) { neg = true; ++i; }
+
+      int64_t amount = 0;
+      uint8_t precision = 0;
+      bool frac = false, digits = false;
+      for( ; i < s.size() && s[i] != ' '; ++i ) {
+         char c = s[i];
+         if( c == '.' && !frac ) { frac = true; continue; }
+         if( c < '0' || c > '9' ) return false;
+         amount = amount * 10 + (c - '0');
+         digits = true;
+         if( frac ) ++precision;
+      }
+      if( !digits || i >= s.size() ) return false;
+
+      out.amount = neg ? -amount : amount;
+      out.precision = precision;
+      out.symbol = s.substr( i + 1 );
+      return !out.symbol.empty();
+   }
+
+   //name string to its 64-bit value, as eosio::string_to_name
+   inline uint64_t name_value( const string& s ) {
+      auto sym = []( char c ) -> uint64_t {
+         if( c >= 'a' && c <= 'z' ) return uint64_t( c - 'a' ) + 6;
+         if( c >= '1' && c <= '5' ) return uint64_t( c - '1' ) + 1;
+         return 0;
+      };
+      uint64_t v = 0;
+      for( size_t i = 0; i < s.size() && i < 12; ++i ) v |= (sym( s[i] ) & 0x1f) << (64 - 5 * (i + 1));
+      if( s.size() > 12 ) v |= sym( s[12] ) & 0x0f;
+      return v;
+   }
+
+   //64-bit name value to its string, as eosio::name::to_string
+   inline string name_string( uint64_t v ) {
+      static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+      string str( 13, '.' );
+      for( uint32_t i = 0; i <= 12; ++i ) {
+         str[12 - i] = charmap[v & (i == 0 ? 0x0f : 0x1f)];
+         v >>= (i == 0 ? 4 : 5);
+      }
+      str.erase( str.find_last_not_of( '.' ) + 1 );
+      return str;
+   }
+
+   //symbol from a raw symbol value, e.g. the scope of the compact ledger tables
+   inline dump_asset symbol_from_raw( uint64_t raw ) {
+      dump_asset a;
+      a.precision = uint8_t( raw & 0xff );
+      for( raw >>= 8; raw > 0; raw >>= 8 ) a.symbol += char( raw & 0xff );
+      return a;
+   }
+
+   //raw symbol value of an asset's precision and symbol code
+   inline uint64_t symbol_raw( const dump_asset& a ) {
+      uint64_t raw = a.precision;
+      for( size_t i = 0; i < a.symbol.size() && i < 7; ++i ) raw |= uint64_t( uint8_t( a.symbol[i] ) ) << (8 * (i + 1));
+      return raw;
+   }
+
+   namespace detail {
+
+      struct json_flattener {
+         const char* p;
+         const char* end;
+         dump_row&   row;
+
+         void ws() { while( p < end && (*p == ' ' || *p == '\t' || *p == '\r') ) ++p; }
+
+         bool str( string& out ) {
+            if( p >= end || *p != '"' ) return false;
+            ++p;
+            while( p < end && *p != '"' ) {
+               if( *p == '\\' && p + 1 < end ) {
+                  ++p;
+                  switch( *p ) {
+                     case 'n': out += '\n'; break;
+                     case 't': out += '\t'; break;
+                     default:  out += *p;   break;   //\uXXXX is kept verbatim minus the backslash
+                  }
+               } else {
+                  out += *p;
+               }
+               ++p;
+            }
+            if( p >= end ) return false;
+            ++p;
+            return true;
+         }
+
+         bool value( const string& key ) {
+            ws();
+            if( p >= end ) return false;
+            if( *p == '{' ) return object( key );
+            if( *p == '[' ) {
+               ++p;
+               size_t n = 0;
+               ws();
+               if( p < end && *p == ']' ) { ++p; return true; }
+               for( ;; ) {
+                  if( !value( key + "." + std::to_string( n++ ) ) ) return false;
+                  ws();
+                  if( p < end && *p == ',' ) { ++p; continue; }
+                  if( p < end && *p == ']' ) { ++p; return true; }
+                  return false;
+               }
+            }
+            string v;
+            bool quoted = *p == '"';
+            if( quoted ) {
+               if( !str( v ) ) return false;
+            } else {
+               while( p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' ) v += *p++;
+            }
+            row.fields.emplace_back( key, std::move( v ) );
+            row.literal.push_back( !quoted );
+            return true;
+         }
+
+         bool object( const string& prefix ) {
+            ++p;
+            ws();
+            if( p < end && *p == '}' ) { ++p; return true; }
+            for( ;; ) {
+               ws();
+               string k;
+               if( !str( k ) ) return false;
+               ws();
+               if( p >= end || *p != ':' ) return false;
+               ++p;
+               if( !value( prefix.empty() ? k : prefix + "." + k ) ) return false;
+               ws();
+               if( p < end && *p == ',' ) { ++p; continue; }
+               if( p < end && *p == '}' ) { ++p; return true; }
+               return false;
+            }
+         }
+      };
+
+   } /// namespace detail
+
+   inline bool parse_row( const char* begin, const char* end, dump_row& row ) {
+      row.fields.clear();
+      row.literal.clear();
+      detail::json_flattener f{ begin, end, row };
+      f.ws();
+      if( f.p >= end || *f.p != '{' ) return false;
+      return f.object( "" );
+   }
+
+   /**
+   * Memory-map a dump and hand each worker a newline-aligned slice of it
+   *
+   * @param path     dump file
+   * @param workers  number of threads
+   * @param fn       called as fn(worker, row) for every parsed row
+   * @return number of lines that failed to parse
+   **/
+   inline uint64_t scan_dump( const string& path, unsigned workers,
+                              const std::function<void(unsigned, const dump_row&)>& fn ) {
+      int fd = ::open( path.c_str(), O_RDONLY );
+      if( fd < 0 ) throw std::runtime_error( "cannot open " + path );
+      struct stat st;
+      if( ::fstat( fd, &st ) != 0 ) { ::close( fd ); throw std::runtime_error( "cannot stat " + path ); }
+      size_t size = size_t( st.st_size );
+      if( size == 0 ) { ::close( fd ); return 0; }
+
+      void* map = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      ::close( fd );
+      if( map == MAP_FAILED ) throw std::runtime_error( "cannot map " + path );
+      const char* data = static_cast<const char*>( map );
+
+      if( workers == 0 ) workers = 1;
+      std::vector<size_t> cuts( workers + 1, size );
+      cuts[0] = 0;
+      for( unsigned w = 1; w < workers; ++w ) {
+         size_t c = std::max( cuts[w - 1], size * w / workers );
+         while( c > 0 && c < size && data[c - 1] != '\n' ) ++c;
+         cuts[w] = c;
+      }
+
+      std::vector<uint64_t> bad( workers, 0 );
+      std::vector<std::thread> threads;
+      for( unsigned w = 0; w < workers; ++w ) {
+         threads.emplace_back( [&, w]() {
+            dump_row row;
+            const char* p = data + cuts[w];
+            const char* e = data + cuts[w + 1];
+            while( p < e ) {
+               const char* nl = static_cast<const char*>( std::memchr( p, '\n', size_t( e - p ) ) );
+               const char* le = nl ? nl : e;
+               if( le > p ) {
+                  if( parse_row( p, le, row ) ) fn( w, row );
+                  else ++bad[w];
+               }
+               p = le + 1;
+            }
+         });
+      }
+      for( auto& t : threads ) t.join();
+      ::munmap( map, size );
+
+      uint64_t total = 0;
+      for( auto b : bad ) total += b;
+      return total;
+   }
+
+} /// namespace tapx
@@ -0,0 +1,305 @@
+/**
+ *  custodyaudit.cpp
+ *  copyright TAPx.io
+ *
+ *  Offline custody audit of tapx and brandedtoken over table dumps.
+ *
+ *  Checks, per contract and symbol:
+ *    - ledger liabilities (tapledgers, btokenlgrs, their cold tiers tapcolds
+ *      and btokencolds, legacy tapbalances and btokenbals not migrated yet,
+ *      cledgers, the unclaimed escrow deposit - withdrawn of open streams)
+ *      plus staked TAPx
+ *      are backed by custody: the contract's own accounts balance plus its
+ *      custody stripes
+ *    - stat supply equals the sum of all accounts balances and custody stripes
+ *    - each registered brand's max_supply equals staked TAPx x rate, plus the
+ *      1 unit brandedtoken::create seeds
+ *    - no balance is negative
+ *
+ *  Every table is scoped by owner or symbol and the checks only sum within a
+ *  symbol, so each worker aggregates its slice of the dump on its own and the
+ *  partial sums are merged once at the end.
+ *
+ *  Build:  g++ -O2 -std=c++17 -pthread custodyaudit.cpp -o custodyaudit
+ *  Usage:  custodyaudit --tapx tapatalktpx1 --brand tapatalkgdp1 [--threads N] [--rate N] dump.jsonl...
+ */
+#include "../../common/tabledump.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+
+using namespace tapx;
+
+namespace {
+
+   typedef __int128 int128;
+
+   //"<code>|<precision>,<symbol>"
+   string key( const string& code, const dump_asset& a ) {
+      return code + "|" + std::to_string( a.precision ) + "," + a.symbol;
+   }
+
+   string format_amount( int128 v, uint8_t precision, const string& symbol ) {
+      bool neg = v < 0;
+      if( neg ) v = -v;
+      string digits;
+      do { digits.insert( digits.begin(), char('0' + int(v % 10)) ); v /= 10; } while( v > 0 );
+      if( precision > 0 ) {
+         if( digits.size() <= precision ) digits.insert( 0, precision + 1 - digits.size(), '0' );
+         digits.insert( digits.size() - precision, "." );
+      }
+      return (neg ? "-" : "") + digits + " " + symbol;
+   }
+
+   struct symbol_totals {
+      uint8_t   precision = 0;
+      string    symbol;
+      int128    holders = 0;        // sum of accounts balances
+      int128    custody = 0;        // accounts balance of the contract itself
+      int128    stripes = 0;        // sum of the custody table
+      int128    ledger = 0;         // sum of ledger balances
+      uint64_t  ledger_rows = 0;
+      bool      has_stat = false;
+      int64_t   supply = 0;
+      int64_t   max_supply = 0;
+
+      void merge( const symbol_totals& o ) {
+         holders += o.holders;
+         custody += o.custody;
+         stripes += o.stripes;
+         ledger += o.ledger;
+         ledger_rows += o.ledger_rows;
+         if( o.has_stat ) {
+            has_stat = true;
+            supply = o.supply;
+            max_supply = o.max_supply;
+         }
+      }
+   };
+
+   struct brand_link {
+      string      contract;
+      dump_asset  staked;
+   };
+
+   struct partial {
+      std::map<string, symbol_totals>   totals;
+      std::map<string, brand_link>      brands;      // by "<precision>,<symbol>"
+      std::vector<string>               negatives;
+      uint64_t                          rows = 0;
+
+      symbol_totals& at( const string& code, const dump_asset& a ) {
+         auto& t = totals[key( code, a )];
+         t.precision = a.precision;
+         t.symbol = a.symbol;
+         return t;
+      }
+   };
+
+   void usage() {
+      std::fprintf( stderr, "usage: custodyaudit --tapx ACCOUNT [--brand ACCOUNT]... [--threads N] [--rate N] DUMP...\n" );
+      std::exit( 2 );
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   string tapx_code;
+   std::set<string> brand_codes;
+   std::vector<string> dumps;
+   unsigned threads = std::thread::hardware_concurrency();
+   int64_t rate = 10;
+
+   for( int i = 1; i < argc; ++i ) {
+      string a = argv[i];
+      if( a == "--tapx" && i + 1 < argc )          tapx_code = argv[++i];
+      else if( a == "--brand" && i + 1 < argc )    brand_codes.insert( argv[++i] );
+      else if( a == "--threads" && i + 1 < argc )  threads = unsigned( std::atoi( argv[++i] ) );
+      else if( a == "--rate" && i + 1 < argc )     rate = std::atoll( argv[++i] );
+      else if( !a.empty() && a[0] == '-' )         usage();
+      else                                         dumps.push_back( a );
+   }
+   if( tapx_code.empty() || dumps.empty() ) usage();
+   if( threads == 0 ) threads = 1;
+
+   std::vector<partial> parts( threads );
+   uint64_t bad = 0;
+
+   for( const auto& path : dumps ) {
+      bad += scan_dump( path, threads, [&]( unsigned w, const dump_row& row ) {
+         partial& part = parts[w];
+         const string& code = row.code();
+         bool is_tapx = code == tapx_code;
+         if( !is_tapx && !brand_codes.count( code ) ) return;
+         ++part.rows;
+
+         const string& table = row.table();
+         dump_asset a;
+         if( table == "accounts" ) {
+            if( !parse_asset( row.get( "value.balance" ), a ) ) return;
+            auto& t = part.at( code, a );
+            t.holders += a.amount;
+            if( row.scope() == code ) t.custody += a.amount;
+            if( a.amount < 0 ) part.negatives.push_back( code + " accounts " + row.scope() + " " + a.to_string() );
+         } else if( table == "stat" ) {
+            dump_asset max;
+            if( !parse_asset( row.get( "value.supply" ), a ) || !parse_asset( row.get( "value.max_supply" ), max ) ) return;
+            auto& t = part.at( code, a );
+            t.has_stat = true;
+            t.supply = a.amount;
+            t.max_supply = max.amount;
+         } else if( table == "tapbalances" || table == "btokenbals" ) {
+            if( !parse_asset( row.get( "value.balance" ), a ) ) return;
+            auto& t = part.at( code, a );
+            t.ledger += a.amount;
+            ++t.ledger_rows;
+            if( a.amount < 0 ) part.negatives.push_back( code + " " + table + " " + row.get( "primary_key" ) + " " + a.to_string() );
+         } else if( table == "tapledgers" || table == "btokenlgrs" ) {
+            //compact rows: the scope is the raw symbol, the row only the amount
+            a = symbol_from_raw( name_value( row.scope() ) );
+            const string& amount = row.get( "value.amount" );
+            if( amount.empty() ) return;
+            a.amount = std::strtoll( amount.c_str(), nullptr, 10 );
+            auto& t = part.at( code, a );
+            t.ledger += a.amount;
+            ++t.ledger_rows;
+            if( a.amount < 0 ) part.negatives.push_back( code + " " + table + " " + row.get( "primary_key" ) + " " + a.to_string() );
+         } else if( table == "cledgers" ) {
+            //community ledgers: all brands in the contract's scope, the row names its symbol as "4,GDP"
+            const string& symbol = row.get( "value.symbol" );
+            const string& amount = row.get( "value.amount" );
+            size_t comma = symbol.find( ',' );
+            if( comma == string::npos || amount.empty() ) return;
+            a.precision = uint8_t( std::atoi( symbol.substr( 0, comma ).c_str() ) );
+            a.symbol = symbol.substr( comma + 1 );
+            a.amount = std::strtoll( amount.c_str(), nullptr, 10 );
+            auto& t = part.at( code, a );
+            t.ledger += a.amount;
+            ++t.ledger_rows;
+            if( a.amount < 0 ) part.negatives.push_back( code + " " + table + " " + row.get( "primary_key" ) + " " + a.to_string() );
+         } else if( table == "tapcolds" || table == "btokencolds" ) {
+            //packed dormant ledgers: the scope is the raw symbol, one amount per ledger in the row
+            a = symbol_from_raw( name_value( row.scope() ) );
+            auto& t = part.at( code, a );
+            for( const auto& f : row.fields ) {
+               if( f.first.compare( 0, 14, "value.amounts." ) != 0 ) continue;
+               int64_t amount = std::strtoll( f.second.c_str(), nullptr, 10 );
+               t.ledger += amount;
+               ++t.ledger_rows;
+               if( amount < 0 ) part.negatives.push_back( code + " " + table + " " + row.get( "primary_key" ) + " " + f.second );
+            }
+         } else if( table == "streams" ) {
+            //escrow taken from the payer's ledger, not yet claimed by the payee
+            dump_asset withdrawn;
+            if( !parse_asset( row.get( "value.deposit" ), a ) || !parse_asset( row.get( "value.withdrawn" ), withdrawn ) ) return;
+            auto& t = part.at( code, a );
+            t.ledger += a.amount - withdrawn.amount;
+            if( a.amount < withdrawn.amount ) part.negatives.push_back( code + " streams " + row.get( "primary_key" ) + " withdrawn " + withdrawn.to_string() + " of " + a.to_string() );
+         } else if( table == "custody" ) {
+            //custody stripes: the scope is the raw symbol, a stripe may be negative
+            a = symbol_from_raw( name_value( row.scope() ) );
+            const string& amount = row.get( "value.amount" );
+            if( amount.empty() ) return;
+            part.at( code, a ).stripes += std::strtoll( amount.c_str(), nullptr, 10 );
+         } else if( table == "brandregs" && is_tapx ) {
+            brand_link link;
+            link.contract = row.get( "value.contract" );
+            if( !parse_asset( row.get( "value.staked" ), link.staked ) ) return;
+            part.brands[row.get( "value.symbol" )] = link;
+         }
+      });
+   }
+
+   //Merge the per-worker partial sums
+   partial all;
+   for( auto& p : parts ) {
+      for( auto& kv : p.totals ) {
+         auto& t = all.totals[kv.first];
+         t.precision = kv.second.precision;
+         t.symbol = kv.second.symbol;
+         t.merge( kv.second );
+      }
+      for( auto& kv : p.brands ) all.brands[kv.first] = kv.second;
+      all.negatives.insert( all.negatives.end(), p.negatives.begin(), p.negatives.end() );
+      all.rows += p.rows;
+   }
+
+   //TAPx held for brands is also backed by the tapx contract balance
+   std::map<string, int128> staked;
+   for( const auto& kv : all.brands ) {
+      staked[key( tapx_code, kv.second.staked )] += kv.second.staked.amount;
+   }
+
+   uint64_t errors = 0;
+   for( const auto& kv : all.totals ) {
+      const auto& t = kv.second;
+      const string code = kv.first.substr( 0, kv.first.find( '|' ) );
+
+      int128 liabilities = t.ledger;
+      auto st = staked.find( kv.first );
+      if( st != staked.end() ) liabilities += st->second;
+
+      int128 custody = t.custody + t.stripes;
+      if( liabilities > 0 || custody > 0 ) {
+         if( custody < liabilities ) {
+            ++errors;
+            std::printf( "ERROR custody %s liabilities=%s custody=%s\n", code.c_str(),
+                         format_amount( liabilities, t.precision, t.symbol ).c_str(),
+                         format_amount( custody, t.precision, t.symbol ).c_str() );
+         } else if( custody > liabilities ) {
+            std::printf( "NOTE  custody %s surplus=%s\n", code.c_str(),
+                         format_amount( custody - liabilities, t.precision, t.symbol ).c_str() );
+         }
+      }
+
+      int128 held = t.holders + t.stripes;
+      if( t.has_stat && int128( t.supply ) != held ) {
+         ++errors;
+         std::printf( "ERROR supply %s stat=%s holders=%s\n", code.c_str(),
+                      format_amount( t.supply, t.precision, t.symbol ).c_str(),
+                      format_amount( held, t.precision, t.symbol ).c_str() );
+      } else if( !t.has_stat && held != 0 ) {
+         ++errors;
+         std::printf( "ERROR supply %s no stat row, holders=%s\n", code.c_str(),
+                      format_amount( held, t.precision, t.symbol ).c_str() );
+      }
+   }
+
+   for( const auto& kv : all.brands ) {
+      const auto& link = kv.second;
+      if( !brand_codes.count( link.contract ) ) continue;
+
+      //brandregs stores the symbol as "4,GDP"
+      size_t comma = kv.first.find( ',' );
+      dump_asset sym;
+      sym.precision = uint8_t( std::atoi( kv.first.substr( 0, comma ).c_str() ) );
+      sym.symbol = kv.first.substr( comma + 1 );
+
+      auto it = all.totals.find( key( link.contract, sym ) );
+      if( it == all.totals.end() || !it->second.has_stat ) {
+         ++errors;
+         std::printf( "ERROR brand %s %s registered but has no stat row\n", link.contract.c_str(), kv.first.c_str() );
+         continue;
+      }
+      int128 expected = int128( link.staked.amount ) * rate + 1;
+      if( int128( it->second.max_supply ) != expected ) {
+         ++errors;
+         std::printf( "ERROR brand %s max_supply=%s staked=%s expected=%s\n", link.contract.c_str(),
+                      format_amount( it->second.max_supply, sym.precision, sym.symbol ).c_str(),
+                      link.staked.to_string().c_str(),
+                      format_amount( expected, sym.precision, sym.symbol ).c_str() );
+      }
+   }
+
+   for( const auto& n : all.negatives ) {
+      ++errors;
+      std::printf( "ERROR negative %s\n", n.c_str() );
+   }
+   if( bad ) std::printf( "WARN  %llu unparsable lines\n", (unsigned long long)bad );
+
+   std::printf( "audited %llu rows with %u threads, %llu discrepancies\n",
+                (unsigned long long)all.rows, threads, (unsigned long long)errors );
+   return errors ? 1 : 0;
+}
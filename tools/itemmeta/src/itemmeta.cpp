@@ -0,0 +1,182 @@
+/**
+ *  itemmeta.cpp
+ *  copyright TAPx.io
+ *
+ *  Convert tapxdgoods item metadata between the JSON of tapxdgoods.json and
+ *  the binary encoding issueitem takes, using the same codec as the contract.
+ *
+ *    encode    JSON item to hex for the metadata argument of issueitem, e.g.
+ *                {"name":"Mug","description":"","imageSmall":"https://x/s.png",
+ *                 "imageLarge":"https://x/l.png","details":{"size":12,"boxed":true}}
+ *              details values keep their JSON type: string, integer or boolean
+ *    decode    hex back to JSON
+ *    validate  check hex against the schema the way issueitem does
+ *
+ *  Build:  g++ -O2 -std=c++17 itemmeta.cpp -o itemmeta
+ *  Usage:  itemmeta encode [file.json] | decode HEX | validate HEX
+ */
+#include "../../common/tabledump.hpp"
+#include "../../../contracts/tapxdgoods/src/itemmeta.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+using namespace tapx;
+
+namespace {
+
+   int usage() {
+      fprintf( stderr, "usage: itemmeta encode [file.json] | decode HEX | validate HEX\n" );
+      return 2;
+   }
+
+   bool parse_int( const string& s, int64_t& out ) {
+      if( s.empty() ) return false;
+      char* endp = nullptr;
+      errno = 0;
+      long long v = strtoll( s.c_str(), &endp, 10 );
+      if( errno || *endp ) return false;
+      out = v;
+      return true;
+   }
+
+   bool from_json( const dump_row& row, itemmeta::item& it, string& error ) {
+      static const string details = "details.";
+      for( size_t i = 0; i < row.fields.size(); ++i ) {
+         const string& k = row.fields[i].first;
+         const string& v = row.fields[i].second;
+         bool literal = row.literal[i];
+         if( k.compare( 0, details.size(), details ) == 0 ) {
+            itemmeta::attribute a;
+            a.key = k.substr( details.size() );
+            if( !literal ) {
+               a.text = v;
+            } else if( v == "true" || v == "false" ) {
+               a.type = itemmeta::value_bool;
+               a.number = v == "true";
+            } else if( parse_int( v, a.number ) ) {
+               a.type = itemmeta::value_int;
+            } else {
+               error = "detail " + a.key + " is not a string, integer or boolean";
+               return false;
+            }
+            it.details.push_back( std::move( a ) );
+         } else if( k == "name" )              it.name = v;
+         else if( k == "description" )         it.description = v;
+         else if( k == "imageSmall" )          it.image_small = v;
+         else if( k == "imageLarge" )          it.image_large = v;
+         else if( k == "authenticityImage" )   it.authenticity_image = v;
+         else {
+            error = "unknown field " + k;
+            return false;
+         }
+      }
+      return true;
+   }
+
+   string quote( const string& s ) {
+      string out = "\"";
+      for( unsigned char c : s ) {
+         if( c == '"' || c == '\\' ) { out += '\\'; out += char(c); }
+         else if( c == '\n' ) out += "\\n";
+         else if( c == '\t' ) out += "\\t";
+         else if( c < 0x20 ) { char buf[8]; snprintf( buf, sizeof(buf), "\\u%04x", c ); out += buf; }
+         else out += char(c);
+      }
+      return out + "\"";
+   }
+
+   string to_json( const itemmeta::item& it ) {
+      string out = "{\"name\":" + quote( it.name ) + ",\"description\":" + quote( it.description ) +
+                   ",\"imageSmall\":" + quote( it.image_small ) + ",\"imageLarge\":" + quote( it.image_large );
+      if( !it.authenticity_image.empty() ) out += ",\"authenticityImage\":" + quote( it.authenticity_image );
+      out += ",\"details\":{";
+      for( size_t i = 0; i < it.details.size(); ++i ) {
+         const auto& a = it.details[i];
+         if( i ) out += ",";
+         out += quote( a.key ) + ":";
+         switch( a.type ) {
+            case itemmeta::value_string: out += quote( a.text ); break;
+            case itemmeta::value_int:    out += std::to_string( a.number ); break;
+            case itemmeta::value_bool:   out += a.number ? "true" : "false"; break;
+         }
+      }
+      return out + "}}";
+   }
+
+   bool from_hex( const string& hex, std::vector<char>& out ) {
+      if( hex.size() % 2 ) return false;
+      for( size_t i = 0; i < hex.size(); i += 2 ) {
+         char* endp = nullptr;
+         string byte = hex.substr( i, 2 );
+         long v = strtol( byte.c_str(), &endp, 16 );
+         if( *endp ) return false;
+         out.push_back( char( v ) );
+      }
+      return true;
+   }
+
+   int encode( std::istream& in ) {
+      string json( (std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>() );
+      for( char& c : json ) if( c == '\n' ) c = ' ';   //the flattener reads one dump line
+
+      dump_row row;
+      if( !parse_row( json.data(), json.data() + json.size(), row ) ) {
+         fprintf( stderr, "itemmeta: malformed JSON\n" );
+         return 1;
+      }
+      itemmeta::item it;
+      string error;
+      if( !from_json( row, it, error ) ) {
+         fprintf( stderr, "itemmeta: %s\n", error.c_str() );
+         return 1;
+      }
+      if( const char* err = itemmeta::validate( it ) ) {
+         fprintf( stderr, "itemmeta: %s\n", err );
+         return 1;
+      }
+      auto data = itemmeta::encode( it );
+      for( unsigned char c : data ) printf( "%02x", c );
+      printf( "\n" );
+      fprintf( stderr, "%zu bytes, %zu as compact JSON\n", data.size(), to_json( it ).size() );
+      return 0;
+   }
+
+   int decode( const string& hex, bool print ) {
+      std::vector<char> data;
+      if( !from_hex( hex, data ) ) {
+         fprintf( stderr, "itemmeta: malformed hex\n" );
+         return 1;
+      }
+      itemmeta::item it;
+      if( const char* err = itemmeta::decode( data.data(), data.size(), it ) ) {
+         fprintf( stderr, "itemmeta: %s\n", err );
+         return 1;
+      }
+      printf( "%s\n", print ? to_json( it ).c_str() : "ok" );
+      return 0;
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   if( argc < 2 ) return usage();
+   string cmd = argv[1];
+   if( cmd == "encode" ) {
+      if( argc < 3 ) return encode( std::cin );
+      std::ifstream file( argv[2] );
+      if( !file ) {
+         fprintf( stderr, "itemmeta: cannot open %s\n", argv[2] );
+         return 1;
+      }
+      return encode( file );
+   }
+   if( argc < 3 ) return usage();
+   if( cmd == "decode" )   return decode( argv[2], true );
+   if( cmd == "validate" ) return decode( argv[2], false );
+   return usage();
+}
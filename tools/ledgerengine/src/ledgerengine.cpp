@@ -0,0 +1,1013 @@
+/**
+ *  ledgerengine.cpp
+ *  copyright TAPx.io
+ *
+ *  Off-chain ledger engine for tapx and brandedtoken ledger balances.
+ *
+ *  Mirrors the on-chain ledger tables (tapledgers, btokenlgrs) in memory,
+ *  keyed by contract, symbol and ledger ID and sharded by ledger ID over
+ *  worker threads. Every accepted operation is appended to a memory-mapped
+ *  write-ahead log and acknowledged once a group commit has synced it.
+ *
+ *  A transfer is debited and logged on the sender's shard and only then
+ *  credited on the receiver's shard, so an operation spending a credit is
+ *  always logged after the operation that made it: replaying the log in
+ *  order reproduces every balance.
+ *
+ *  Periodically the committed log is folded into net trfledger/trfbtoken
+ *  transfers followed by wdrledger/wdrbtoken withdrawals and appended to
+ *  DATA/anchors.jsonl, one transaction per line, to be pushed in order. Each
+ *  action carries an opid, so pushing a line twice is a no-op on chain.
+ *  Anchor opids are numbered from --opid-base (default 2^63) up, so clients
+ *  sending their own opids to the same contracts must keep them below it.
+ *  Deposits happen on chain (depledger/depbtoken) and are only mirrored.
+ *
+ *  When the log fills up the shards are paused, everything is anchored and a
+ *  snapshot of all balances replaces the log.
+ *
+ *  Operations, one JSON object per line on stdin:
+ *    {"id":"t1","op":"transfer","code":"tapatalkgdp1","quantity":"1.0000 GDP","from":"alice","to":"bob"}
+ *    {"id":"d1","op":"deposit","code":"tapatalktpx1","quantity":"5.0000 TAP","to":"alice"}
+ *    {"id":"w1","op":"withdraw","code":"tapatalktpx1","quantity":"1.0000 TAP","from":"alice","to":"aliceeosacct"}
+ *  Each is answered on stdout once committed, or at once if rejected.
+ *
+ *  Build:  g++ -O2 -std=c++17 -pthread ledgerengine.cpp -o ledgerengine
+ *  Usage:  ledgerengine --tapx tapatalktpx1 --dir DATA [--shards N] [--wal-mb N] [--anchor-secs N] [--opid-base N] < ops.jsonl
+ *          ledgerengine --tapx tapatalktpx1 --dir DATA --bench [--accounts N] [--ops N]
+ *          ledgerengine --tapx tapatalktpx1 --dir DATA --status
+ */
+#include "../../common/tabledump.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+
+using namespace tapx;
+
+namespace {
+
+   typedef std::chrono::steady_clock clock_type;
+
+   static constexpr int64_t  max_amount = (1LL << 62) - 1;
+   static constexpr uint64_t wal_magic = 0x314c4157584154ULL;          // "TAPXWAL1"
+   static constexpr uint64_t snapshot_magic = 0x31504e53584154ULL;     // "TAPXSNP1"
+   static constexpr size_t   max_batch = 4096;                         // operations per worker batch
+   static constexpr size_t   inbox_limit = 64 * 1024;                  // queued operations per shard
+   static constexpr uint64_t opid_actions = 1ULL << 24;                // actions per anchor batch
+
+   enum op_kind : uint32_t {
+      op_deposit = 1,
+      op_withdraw,
+      op_transfer,
+      op_anchor          // from = first seq, to = end seq, amount = batch
+   };
+
+   //One log record, a cache line each
+   struct wal_record {
+      uint64_t    seq;
+      uint64_t    code;
+      uint64_t    symbol;
+      uint64_t    from;
+      uint64_t    to;
+      int64_t     amount;
+      uint32_t    kind;
+      uint32_t    check;
+      uint64_t    boot;          // log open count when written
+   };
+   static_assert( sizeof(wal_record) == 64, "wal_record must stay one cache line" );
+
+   struct wal_header {
+      uint64_t    magic;
+      uint64_t    gen;
+      uint64_t    base_seq;
+      uint64_t    boot;          // bumped every time the log is reopened
+      uint64_t    reserved[4];
+   };
+   static_assert( sizeof(wal_header) == sizeof(wal_record), "header takes the first record slot" );
+
+   uint32_t record_check( const wal_record& r ) {
+      //FNV-1a over the record with the check field zeroed
+      wal_record c = r;
+      c.check = 0;
+      const unsigned char* p = reinterpret_cast<const unsigned char*>( &c );
+      uint32_t h = 2166136261u;
+      for( size_t i = 0; i < sizeof(c); ++i ) { h ^= p[i]; h *= 16777619u; }
+      return h | 1;      //never 0, so a zeroed slot is never valid
+   }
+
+   struct ledger_key {
+      uint64_t    code;
+      uint64_t    symbol;
+      uint64_t    lgid;
+
+      bool operator==( const ledger_key& o )const {
+         return code == o.code && symbol == o.symbol && lgid == o.lgid;
+      }
+   };
+
+   uint64_t mix( uint64_t h ) {
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+      return h ^ (h >> 31);
+   }
+
+   struct ledger_hash {
+      size_t operator()( const ledger_key& k )const {
+         return size_t( mix( k.lgid ^ mix( k.symbol ^ mix( k.code ) ) ) );
+      }
+   };
+
+   struct op {
+      uint32_t    kind;
+      uint64_t    code;
+      uint64_t    symbol;
+      uint64_t    from;
+      uint64_t    to;
+      int64_t     amount;
+      string      id;
+   };
+
+   struct credit {
+      ledger_key  key;
+      int64_t     amount;
+   };
+
+   //Memory-mapped append-only log with group commit
+   class wal {
+      public:
+         ~wal() { close(); }
+
+         //Map an existing log, or create one if missing or of another generation
+         void open( const string& path, size_t capacity, uint64_t gen, uint64_t base_seq ) {
+            _path = path;
+            _capacity = capacity;
+            int fd = ::open( path.c_str(), O_RDWR );
+            if( fd >= 0 ) {
+               struct stat st;
+               wal_header h{};
+               if( ::fstat( fd, &st ) == 0 && size_t( st.st_size ) >= sizeof(wal_header) &&
+                   ::pread( fd, &h, sizeof(h), 0 ) == ssize_t( sizeof(h) ) &&
+                   h.magic == wal_magic && h.gen == gen ) {
+                  _capacity = size_t( st.st_size ) / sizeof(wal_record) - 1;
+                  map( fd );
+                  _gen = gen;
+                  _base_seq = h.base_seq;
+                  _boot = h.boot;
+                  recover_tail();
+                  return;
+               }
+               ::close( fd );
+            }
+            create( gen, base_seq );
+         }
+
+         //Replace the log by an empty one of the next generation
+         void create( uint64_t gen, uint64_t base_seq ) {
+            close();
+            string tmp = _path + ".tmp";
+            int fd = ::open( tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+            if( fd < 0 ) throw std::runtime_error( "cannot create " + tmp );
+            if( ::ftruncate( fd, off_t( (_capacity + 1) * sizeof(wal_record) ) ) != 0 ) {
+               ::close( fd );
+               throw std::runtime_error( "cannot size " + tmp );
+            }
+            wal_header h{};
+            h.magic = wal_magic;
+            h.gen = gen;
+            h.base_seq = base_seq;
+            if( ::pwrite( fd, &h, sizeof(h), 0 ) != ssize_t( sizeof(h) ) || ::fsync( fd ) != 0 ) {
+               ::close( fd );
+               throw std::runtime_error( "cannot write " + tmp );
+            }
+            if( ::rename( tmp.c_str(), _path.c_str() ) != 0 ) {
+               ::close( fd );
+               throw std::runtime_error( "cannot rename " + tmp );
+            }
+            map( fd );
+            _gen = gen;
+            _base_seq = base_seq;
+            _boot = 0;
+            _written = 0;
+            _synced = 0;
+            _durable = base_seq;
+         }
+
+         void close() {
+            if( _records ) {
+               ::munmap( _map, _map_size );
+               _records = nullptr;
+            }
+         }
+
+         //Append records, assigning their sequence numbers
+         void append( wal_record* recs, size_t n ) {
+            std::lock_guard<std::mutex> l( _mutex );
+            if( _written + n > _capacity ) throw std::runtime_error( "write-ahead log overflow" );
+            for( size_t i = 0; i < n; ++i ) {
+               recs[i].seq = _base_seq + _written + i;
+               recs[i].boot = _boot;
+               recs[i].check = record_check( recs[i] );
+            }
+            std::memcpy( _records + _written, recs, n * sizeof(wal_record) );
+            _written += n;
+         }
+
+         //Group commit: sync everything appended so far, return the durable end seq
+         uint64_t sync() {
+            size_t end;
+            {
+               std::lock_guard<std::mutex> l( _mutex );
+               end = _written;
+            }
+            if( end > _synced ) {
+               static const size_t page = size_t( ::sysconf( _SC_PAGESIZE ) );
+               size_t from = (_synced + 1) * sizeof(wal_record) / page * page;
+               size_t to = (end + 1) * sizeof(wal_record);
+               if( ::msync( _map + from, to - from, MS_SYNC ) != 0 ) throw std::runtime_error( "cannot sync " + _path );
+               _synced = end;
+               ++_syncs;
+               _durable = _base_seq + end;
+            }
+            return _durable;
+         }
+
+         size_t written()const {
+            std::lock_guard<std::mutex> l( _mutex );
+            return _written;
+         }
+
+         const wal_record& at( uint64_t seq )const { return _records[seq - _base_seq]; }
+         uint64_t gen()const { return _gen; }
+         uint64_t base_seq()const { return _base_seq; }
+         uint64_t end_seq()const { return _base_seq + written(); }
+         uint64_t durable()const { return _durable; }
+         size_t   capacity()const { return _capacity; }
+         uint64_t syncs()const { return _syncs; }
+
+      private:
+         void map( int fd ) {
+            _map_size = (_capacity + 1) * sizeof(wal_record);
+            void* m = ::mmap( nullptr, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+            ::close( fd );
+            if( m == MAP_FAILED ) throw std::runtime_error( "cannot map " + _path );
+            _map = static_cast<char*>( m );
+            _records = reinterpret_cast<wal_record*>( _map ) + 1;
+         }
+
+         /**
+         * The valid prefix ends at the first slot with a bad check, out of
+         * sequence, or written by an earlier open than the slot before it.
+         *
+         * Records past a torn slot may have reached the disk and still pass
+         * their check. Appends after this open carry the next boot number, so
+         * a stale record left behind them is older than its predecessor and
+         * ends the prefix on the next recovery, however far out it lies.
+         **/
+         void recover_tail() {
+            size_t n = 0;
+            while( n < _capacity && _records[n].kind != 0 && _records[n].seq == _base_seq + n &&
+                   _records[n].boot <= _boot && (n == 0 || _records[n].boot >= _records[n - 1].boot) &&
+                   _records[n].check == record_check( _records[n] ) ) ++n;
+            ++_boot;
+            reinterpret_cast<wal_header*>( _map )->boot = _boot;
+            if( ::msync( _map, sizeof(wal_header), MS_SYNC ) != 0 ) throw std::runtime_error( "cannot sync " + _path );
+            _written = n;
+            _synced = 0;
+            _durable = _base_seq;
+            sync();
+         }
+
+         string               _path;
+         char*                _map = nullptr;
+         size_t               _map_size = 0;
+         wal_record*          _records = nullptr;
+         size_t               _capacity = 0;
+         uint64_t             _gen = 0;
+         uint64_t             _base_seq = 0;
+         uint64_t             _boot = 0;
+         mutable std::mutex   _mutex;
+         size_t               _written = 0;
+         size_t               _synced = 0;
+         std::atomic<uint64_t> _durable{0};
+         uint64_t             _syncs = 0;
+   };
+
+   struct shard {
+      std::mutex                 mutex;
+      std::condition_variable    ready;
+      std::condition_variable    space;
+      std::vector<op>            ops;
+      std::vector<credit>        credits;
+      std::unordered_map<ledger_key, int64_t, ledger_hash> balances;
+   };
+
+   struct config {
+      uint64_t    tapx_code = 0;
+      string      dir;
+      unsigned    shards = std::max( 1u, std::thread::hardware_concurrency() );
+      size_t      wal_mb = 1024;
+      uint32_t    anchor_secs = 10;
+      size_t      anchor_actions = 50;
+      uint64_t    opid_base = 1ULL << 63;
+      bool        acks = true;
+   };
+
+   class engine {
+      public:
+         explicit engine( const config& cfg ) : _cfg( cfg ), _shards( cfg.shards ) {}
+
+         //Load the snapshot, replay the log and finish an interrupted anchor
+         void recover() {
+            uint64_t gen = 0, base_seq = 0;
+            load_snapshot( gen, base_seq );
+            _wal.open( _cfg.dir + "/wal", _cfg.wal_mb * 1024 * 1024 / sizeof(wal_record), gen, base_seq );
+            _anchored = _wal.base_seq();
+
+            uint64_t pending_batch = 0, pending_from = 0, pending_to = 0;
+            for( uint64_t seq = _wal.base_seq(); seq < _wal.end_seq(); ++seq ) {
+               const wal_record& r = _wal.at( seq );
+               if( r.kind == op_anchor ) {
+                  _batch = uint64_t( r.amount );
+                  _anchored = r.to;
+                  ++_anchor_records;
+                  pending_batch = _batch; pending_from = r.from; pending_to = r.to;
+                  continue;
+               }
+               apply( r );
+            }
+            _replayed = _wal.end_seq() - _wal.base_seq();
+            _committed = _replayed - _anchor_records;
+            if( pending_batch && !anchor_complete( pending_batch ) ) {
+               emit_anchor( pending_batch, pending_from, pending_to );
+            }
+         }
+
+         void start() {
+            _coordinator = std::thread( [this]() { coordinate(); } );
+            for( unsigned s = 0; s < _cfg.shards; ++s ) {
+               _workers.emplace_back( [this, s]() { work( s ); } );
+            }
+         }
+
+         //Queue operations, blocking while the owning shard is backed up
+         void submit( op&& o ) {
+            shard& sh = _shards[shard_of( o.kind == op_deposit ? o.to : o.from )];
+            std::unique_lock<std::mutex> l( sh.mutex );
+            sh.space.wait( l, [&]() { return sh.ops.size() < inbox_limit; } );
+            sh.ops.push_back( std::move( o ) );
+            if( sh.ops.size() == 1 ) sh.ready.notify_one();
+         }
+
+         void submit( unsigned s, std::vector<op>& batch ) {
+            shard& sh = _shards[s];
+            std::unique_lock<std::mutex> l( sh.mutex );
+            sh.space.wait( l, [&]() { return sh.ops.size() < inbox_limit; } );
+            bool was_empty = sh.ops.empty();
+            for( auto& o : batch ) sh.ops.push_back( std::move( o ) );
+            batch.clear();
+            if( was_empty ) sh.ready.notify_one();
+         }
+
+         //Finish queued operations, commit and anchor everything, stop the threads
+         void stop() {
+            for( auto& sh : _shards ) {
+               std::unique_lock<std::mutex> l( sh.mutex );
+               sh.space.wait( l, [&]() { return sh.ops.empty(); } );
+            }
+            _stopping = true;
+            request_pause();
+            _coordinator.join();
+            for( auto& w : _workers ) w.join();
+         }
+
+         unsigned shard_of( uint64_t lgid )const { return unsigned( mix( lgid ) % _cfg.shards ); }
+
+         //Balances per contract and symbol, workers must be stopped
+         std::map<std::pair<uint64_t, uint64_t>, std::pair<int64_t, uint64_t>> totals()const {
+            std::map<std::pair<uint64_t, uint64_t>, std::pair<int64_t, uint64_t>> t;
+            for( const auto& sh : _shards ) {
+               for( const auto& kv : sh.balances ) {
+                  auto& v = t[{ kv.first.code, kv.first.symbol }];
+                  v.first += kv.second;
+                  ++v.second;
+               }
+            }
+            return t;
+         }
+
+         uint64_t durable()const { return _wal.durable(); }
+         uint64_t committed()const { return _committed; }
+         uint64_t rejected()const { return _rejected; }
+         uint64_t replayed()const { return _replayed; }
+         uint64_t syncs()const { return _wal.syncs() + _prior_syncs; }
+         uint64_t rotations()const { return _rotations; }
+         uint64_t batches()const { return _batches; }
+         uint64_t actions()const { return _actions; }
+
+      private:
+         void apply( const wal_record& r ) {
+            auto& from = _shards[shard_of( r.from )].balances;
+            auto& to = _shards[shard_of( r.to )].balances;
+            switch( r.kind ) {
+               case op_deposit:  to[{ r.code, r.symbol, r.to }] += r.amount; break;
+               case op_withdraw: from[{ r.code, r.symbol, r.from }] -= r.amount; break;
+               case op_transfer:
+                  from[{ r.code, r.symbol, r.from }] -= r.amount;
+                  to[{ r.code, r.symbol, r.to }] += r.amount;
+                  break;
+            }
+         }
+
+         void reject( const op& o, const char* why ) {
+            ++_rejected;
+            if( !_cfg.acks ) return;
+            std::lock_guard<std::mutex> l( _out_mutex );
+            std::printf( "{\"id\":\"%s\",\"status\":\"rejected\",\"error\":\"%s\"}\n", o.id.c_str(), why );
+         }
+
+         void work( unsigned s ) {
+            shard& sh = _shards[s];
+            std::vector<op> batch;
+            std::vector<credit> credits;
+            std::vector<wal_record> recs;
+            std::vector<std::vector<credit>> forward( _cfg.shards );
+            std::vector<size_t> accepted;
+            std::vector<std::pair<uint64_t, string>> acks;
+            batch.reserve( max_batch );
+            recs.reserve( max_batch );
+
+            for( ;; ) {
+               if( _pause ) {
+                  if( !pause_point( sh ) ) return;
+                  continue;
+               }
+               {
+                  std::unique_lock<std::mutex> l( sh.mutex );
+                  sh.ready.wait( l, [&]() { return _pause || !sh.ops.empty() || !sh.credits.empty(); } );
+                  credits.swap( sh.credits );
+                  size_t n = std::min( sh.ops.size(), max_batch );
+                  std::move( sh.ops.begin(), sh.ops.begin() + n, std::back_inserter( batch ) );
+                  sh.ops.erase( sh.ops.begin(), sh.ops.begin() + n );
+                  if( n ) sh.space.notify_all();
+               }
+
+               //credits first, operations of this batch may spend them
+               for( const auto& c : credits ) sh.balances[c.key] += c.amount;
+               credits.clear();
+
+               for( size_t i = 0; i < batch.size(); ++i ) {
+                  const op& o = batch[i];
+                  if( o.amount <= 0 || o.amount > max_amount ) { reject( o, "invalid quantity" ); continue; }
+                  if( o.kind != op_deposit ) {
+                     auto it = sh.balances.find( { o.code, o.symbol, o.from } );
+                     if( it == sh.balances.end() || it->second < o.amount ) { reject( o, "overdrawn balance" ); continue; }
+                     it->second -= o.amount;
+                  }
+                  if( o.kind != op_withdraw ) {
+                     ledger_key to{ o.code, o.symbol, o.to };
+                     unsigned t = shard_of( o.to );
+                     if( t == s ) sh.balances[to] += o.amount;
+                     else forward[t].push_back( { to, o.amount } );
+                  }
+                  wal_record r{};
+                  r.code = o.code; r.symbol = o.symbol; r.from = o.from; r.to = o.to;
+                  r.amount = o.amount; r.kind = o.kind;
+                  recs.push_back( r );
+                  accepted.push_back( i );
+               }
+
+               //log before crediting other shards, then hand over the credits
+               if( !recs.empty() ) {
+                  _wal.append( recs.data(), recs.size() );
+                  if( _cfg.acks ) {
+                     for( size_t i = 0; i < recs.size(); ++i ) {
+                        acks.emplace_back( recs[i].seq, std::move( batch[accepted[i]].id ) );
+                     }
+                     std::lock_guard<std::mutex> l( _ack_mutex );
+                     for( auto& a : acks ) _acks.push_back( std::move( a ) );
+                     acks.clear();
+                  }
+                  if( _wal.written() > rotation_point() ) request_pause();
+               }
+               for( unsigned t = 0; t < _cfg.shards; ++t ) {
+                  if( forward[t].empty() ) continue;
+                  shard& to = _shards[t];
+                  std::lock_guard<std::mutex> l( to.mutex );
+                  bool was_empty = to.credits.empty() && to.ops.empty();
+                  to.credits.insert( to.credits.end(), forward[t].begin(), forward[t].end() );
+                  if( was_empty ) to.ready.notify_one();
+                  forward[t].clear();
+               }
+               batch.clear();
+               recs.clear();
+               accepted.clear();
+            }
+         }
+
+         //Room left for one batch per shard and the anchor records
+         size_t rotation_point()const {
+            size_t reserve = size_t( _cfg.shards + 1 ) * max_batch + 16;
+            return _wal.capacity() > 2 * reserve ? _wal.capacity() - reserve : _wal.capacity() / 2;
+         }
+
+         void request_pause() {
+            if( _pause.exchange( true ) ) return;
+            for( auto& sh : _shards ) {
+               std::lock_guard<std::mutex> l( sh.mutex );
+               sh.ready.notify_all();
+            }
+            std::lock_guard<std::mutex> l( _ctl_mutex );
+            _ctl.notify_all();
+         }
+
+         //Park until the coordinator resumes; false when the engine stops
+         bool pause_point( shard& sh ) {
+            std::unique_lock<std::mutex> l( _ctl_mutex );
+            uint64_t epoch = _epoch;
+            ++_paused;
+            _ctl.notify_all();
+            _ctl.wait( l, [&]() { return _draining || _epoch != epoch; } );
+            if( _epoch == epoch ) {
+               //every shard has stopped producing credits, take the last ones
+               l.unlock();
+               {
+                  std::lock_guard<std::mutex> sl( sh.mutex );
+                  for( const auto& c : sh.credits ) sh.balances[c.key] += c.amount;
+                  sh.credits.clear();
+               }
+               l.lock();
+               ++_drained;
+               _ctl.notify_all();
+               _ctl.wait( l, [&]() { return _epoch != epoch || _exit; } );
+            }
+            return !_exit;
+         }
+
+         void coordinate() {
+            auto last_anchor = clock_type::now();
+            for( ;; ) {
+               {
+                  std::unique_lock<std::mutex> l( _ctl_mutex );
+                  _ctl.wait_for( l, std::chrono::milliseconds( 1 ), [&]() { return bool( _pause ); } );
+               }
+               commit();
+
+               if( _stopping ) request_pause();
+               if( _pause ) {
+                  quiesce();
+                  if( _stopping ) {
+                     if( _anchored < _wal.durable() ) anchor();
+                     std::lock_guard<std::mutex> l( _ctl_mutex );
+                     _exit = true;
+                     _ctl.notify_all();
+                     return;
+                  }
+                  rotate();
+                  resume();
+                  last_anchor = clock_type::now();
+               } else if( _anchored < _wal.durable() &&
+                          clock_type::now() - last_anchor >= std::chrono::seconds( _cfg.anchor_secs ) ) {
+                  anchor();
+                  last_anchor = clock_type::now();
+               }
+            }
+         }
+
+         //Sync the log and answer the operations it made durable
+         void commit() {
+            uint64_t durable = _wal.sync();
+            std::vector<std::pair<uint64_t, string>> done;
+            {
+               std::lock_guard<std::mutex> l( _ack_mutex );
+               size_t n = 0;
+               while( n < _acks.size() && _acks[n].first < durable ) ++n;
+               done.assign( std::make_move_iterator( _acks.begin() ), std::make_move_iterator( _acks.begin() + n ) );
+               _acks.erase( _acks.begin(), _acks.begin() + n );
+            }
+            _committed = durable - _wal.base_seq() + _prior_committed - _anchor_records;
+            if( done.empty() ) return;
+            std::lock_guard<std::mutex> l( _out_mutex );
+            for( const auto& a : done ) {
+               std::printf( "{\"id\":\"%s\",\"status\":\"committed\",\"seq\":%llu}\n", a.second.c_str(), (unsigned long long)a.first );
+            }
+            std::fflush( stdout );
+         }
+
+         void quiesce() {
+            std::unique_lock<std::mutex> l( _ctl_mutex );
+            _ctl.wait( l, [&]() { return _paused == _cfg.shards; } );
+            _draining = true;
+            _ctl.notify_all();
+            _ctl.wait( l, [&]() { return _drained == _cfg.shards; } );
+            l.unlock();
+            commit();
+         }
+
+         void resume() {
+            std::lock_guard<std::mutex> l( _ctl_mutex );
+            _paused = 0;
+            _drained = 0;
+            _draining = false;
+            _pause = false;
+            ++_epoch;
+            _ctl.notify_all();
+         }
+
+         //Anchor the whole log, snapshot the balances and start a fresh log
+         void rotate() {
+            if( _anchored < _wal.durable() ) anchor();
+            uint64_t gen = _wal.gen() + 1;
+            uint64_t base_seq = _wal.end_seq();
+            write_snapshot( gen, base_seq );
+            _prior_syncs += _wal.syncs();
+            _prior_committed += _wal.durable() - _wal.base_seq();
+            _wal.create( gen, base_seq );
+            _anchored = base_seq;
+            ++_rotations;
+         }
+
+         //Log the anchor intent, then write the batch it names
+         void anchor() {
+            uint64_t from = _anchored, to = _wal.durable();
+            wal_record r{};
+            r.kind = op_anchor;
+            r.from = from;
+            r.to = to;
+            r.amount = int64_t( ++_batch );
+            _wal.append( &r, 1 );
+            ++_anchor_records;
+            commit();
+            emit_anchor( _batch, from, to );
+            _anchored = to;
+         }
+
+         string action( uint64_t code, const char* name, const char* from_field, uint64_t from,
+                        const char* to_field, uint64_t to, uint64_t symbol, int64_t amount, uint64_t opid )const {
+            dump_asset q = symbol_from_raw( symbol );
+            q.amount = amount;
+            string c = name_string( code );
+            return "{\"account\":\"" + c + "\",\"name\":\"" + name + "\",\"authorization\":[{\"actor\":\"" + c +
+                   "\",\"permission\":\"active\"}],\"data\":{\"" + from_field + "\":\"" + name_string( from ) +
+                   "\",\"" + to_field + "\":\"" + name_string( to ) + "\",\"quantity\":\"" + q.to_string() +
+                   "\",\"opid\":" + std::to_string( opid ) + "}}";
+         }
+
+         /**
+         * Fold a committed log range into net on-chain operations
+         *
+         * Transfers are netted per ledger and paired greedily, negative and
+         * positive nets in ledger order, so n ledgers need at most n - 1
+         * transfers. All transfers come before all withdrawals: a ledger's net
+         * debit never exceeds its anchored on-chain balance, and a withdrawal
+         * never exceeds that balance plus the ledger's net credit.
+         **/
+         void emit_anchor( uint64_t batch, uint64_t from, uint64_t to ) {
+            std::map<std::pair<uint64_t, uint64_t>, std::map<uint64_t, int64_t>> net;
+            std::map<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>, int64_t> withdrawals;
+            for( uint64_t seq = from; seq < to; ++seq ) {
+               const wal_record& r = _wal.at( seq );
+               if( r.kind == op_transfer ) {
+                  auto& book = net[{ r.code, r.symbol }];
+                  book[r.from] -= r.amount;
+                  book[r.to] += r.amount;
+               } else if( r.kind == op_withdraw ) {
+                  withdrawals[std::make_tuple( r.code, r.symbol, r.from, r.to )] += r.amount;
+               }
+            }
+
+            std::vector<string> actions;
+            if( batch >= (~0ULL - _cfg.opid_base) / opid_actions ) throw std::runtime_error( "anchor opids exhausted" );
+            uint64_t first = _cfg.opid_base + batch * opid_actions, opid = first;
+            for( const auto& book : net ) {
+               uint64_t code = book.first.first, symbol = book.first.second;
+               bool is_tapx = code == _cfg.tapx_code;
+               std::vector<std::pair<uint64_t, int64_t>> neg, pos;
+               for( const auto& kv : book.second ) {
+                  if( kv.second < 0 ) neg.emplace_back( kv.first, -kv.second );
+                  else if( kv.second > 0 ) pos.emplace_back( kv.first, kv.second );
+               }
+               size_t i = 0, j = 0;
+               while( i < neg.size() && j < pos.size() ) {
+                  int64_t amount = std::min( neg[i].second, pos[j].second );
+                  actions.push_back( is_tapx
+                     ? action( code, "trfledger", "ledger_from", neg[i].first, "ledger_to", pos[j].first, symbol, amount, ++opid )
+                     : action( code, "trfbtoken", "lgid_from", neg[i].first, "lgid_to", pos[j].first, symbol, amount, ++opid ) );
+                  if( (neg[i].second -= amount) == 0 ) ++i;
+                  if( (pos[j].second -= amount) == 0 ) ++j;
+               }
+            }
+            for( const auto& w : withdrawals ) {
+               uint64_t code = std::get<0>( w.first );
+               actions.push_back( code == _cfg.tapx_code
+                  ? action( code, "wdrledger", "ledger_from", std::get<2>( w.first ), "tapx_to", std::get<3>( w.first ),
+                            std::get<1>( w.first ), w.second, ++opid )
+                  : action( code, "wdrbtoken", "lgid_from", std::get<2>( w.first ), "btoken_to", std::get<3>( w.first ),
+                            std::get<1>( w.first ), w.second, ++opid ) );
+            }
+            if( opid - first >= opid_actions ) throw std::runtime_error( "anchor batch too large" );
+
+            string path = _cfg.dir + "/anchors.jsonl";
+            int fd = ::open( path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644 );
+            if( fd < 0 ) throw std::runtime_error( "cannot open " + path );
+            size_t per = std::max<size_t>( 1, _cfg.anchor_actions );
+            size_t parts = std::max<size_t>( 1, (actions.size() + per - 1) / per );
+            string out;
+            for( size_t p = 0; p < parts; ++p ) {
+               out += "{\"anchor\":" + std::to_string( batch ) + ",\"part\":" + std::to_string( p ) +
+                      ",\"parts\":" + std::to_string( parts ) + ",\"from_seq\":" + std::to_string( from ) +
+                      ",\"to_seq\":" + std::to_string( to ) + ",\"actions\":[";
+               for( size_t a = p * per; a < std::min( actions.size(), (p + 1) * per ); ++a ) {
+                  if( a > p * per ) out += ",";
+                  out += actions[a];
+               }
+               out += "]}\n";
+            }
+            bool ok = ::write( fd, out.data(), out.size() ) == ssize_t( out.size() ) && ::fsync( fd ) == 0;
+            ::close( fd );
+            if( !ok ) throw std::runtime_error( "cannot write " + path );
+            ++_batches;
+            _actions += actions.size();
+         }
+
+         //Whether the last complete line of the anchor file closes this batch
+         bool anchor_complete( uint64_t batch ) {
+            string path = _cfg.dir + "/anchors.jsonl";
+            int fd = ::open( path.c_str(), O_RDWR );
+            if( fd < 0 ) return false;
+            struct stat st;
+            if( ::fstat( fd, &st ) != 0 ) { ::close( fd ); return false; }
+            size_t size = size_t( st.st_size ), tail = std::min<size_t>( size, 1 << 20 );
+            string buf( tail, '\0' );
+            if( ::pread( fd, &buf[0], tail, off_t( size - tail ) ) != ssize_t( tail ) ) { ::close( fd ); return false; }
+
+            //drop a torn last line
+            size_t end = buf.find_last_of( '\n' );
+            if( end == string::npos ) end = 0; else ++end;
+            if( end < tail && ::ftruncate( fd, off_t( size - tail + end ) ) != 0 ) { ::close( fd ); return false; }
+            ::close( fd );
+            if( end == 0 ) return false;
+
+            size_t begin = end >= 2 ? buf.find_last_of( '\n', end - 2 ) : string::npos;
+            begin = begin == string::npos ? 0 : begin + 1;
+            dump_row row;
+            if( !parse_row( buf.data() + begin, buf.data() + end - 1, row ) ) return false;
+            return std::strtoull( row.get( "anchor" ).c_str(), nullptr, 10 ) == batch &&
+                   std::strtoull( row.get( "part" ).c_str(), nullptr, 10 ) + 1 ==
+                   std::strtoull( row.get( "parts" ).c_str(), nullptr, 10 );
+         }
+
+         struct snapshot_header {
+            uint64_t    magic;
+            uint64_t    gen;
+            uint64_t    base_seq;
+            uint64_t    batch;
+            uint64_t    count;
+         };
+
+         struct snapshot_entry {
+            uint64_t    code;
+            uint64_t    symbol;
+            uint64_t    lgid;
+            int64_t     amount;
+         };
+
+         void write_snapshot( uint64_t gen, uint64_t base_seq ) {
+            std::vector<snapshot_entry> entries;
+            for( const auto& sh : _shards ) {
+               for( const auto& kv : sh.balances ) {
+                  if( kv.second != 0 ) entries.push_back( { kv.first.code, kv.first.symbol, kv.first.lgid, kv.second } );
+               }
+            }
+            snapshot_header h{ snapshot_magic, gen, base_seq, _batch, entries.size() };
+
+            string path = _cfg.dir + "/snapshot", tmp = path + ".tmp";
+            int fd = ::open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+            if( fd < 0 ) throw std::runtime_error( "cannot create " + tmp );
+            size_t bytes = entries.size() * sizeof(snapshot_entry);
+            bool ok = ::write( fd, &h, sizeof(h) ) == ssize_t( sizeof(h) ) &&
+                      ( bytes == 0 || ::write( fd, entries.data(), bytes ) == ssize_t( bytes ) ) &&
+                      ::fsync( fd ) == 0;
+            ::close( fd );
+            if( !ok || ::rename( tmp.c_str(), path.c_str() ) != 0 ) throw std::runtime_error( "cannot write " + path );
+         }
+
+         void load_snapshot( uint64_t& gen, uint64_t& base_seq ) {
+            string path = _cfg.dir + "/snapshot";
+            int fd = ::open( path.c_str(), O_RDONLY );
+            if( fd < 0 ) return;
+            snapshot_header h{};
+            if( ::read( fd, &h, sizeof(h) ) != ssize_t( sizeof(h) ) || h.magic != snapshot_magic ) {
+               ::close( fd );
+               throw std::runtime_error( "corrupt " + path );
+            }
+            std::vector<snapshot_entry> entries( h.count );
+            size_t bytes = entries.size() * sizeof(snapshot_entry);
+            bool ok = bytes == 0 || ::read( fd, entries.data(), bytes ) == ssize_t( bytes );
+            ::close( fd );
+            if( !ok ) throw std::runtime_error( "corrupt " + path );
+            for( const auto& e : entries ) {
+               _shards[shard_of( e.lgid )].balances[{ e.code, e.symbol, e.lgid }] = e.amount;
+            }
+            gen = h.gen;
+            base_seq = h.base_seq;
+            _batch = h.batch;
+         }
+
+         config                     _cfg;
+         std::vector<shard>         _shards;
+         wal                        _wal;
+         std::thread                _coordinator;
+         std::vector<std::thread>   _workers;
+
+         std::mutex                 _ctl_mutex;
+         std::condition_variable    _ctl;
+         std::atomic<bool>          _pause{false};
+         uint64_t                   _epoch = 0;
+         bool                       _draining = false;
+         bool                       _exit = false;
+         std::atomic<bool>          _stopping{false};
+         unsigned                   _paused = 0;
+         unsigned                   _drained = 0;
+
+         std::mutex                 _ack_mutex;
+         std::vector<std::pair<uint64_t, string>> _acks;
+         std::mutex                 _out_mutex;
+
+         uint64_t                   _anchored = 0;       // end seq of the last anchor batch
+         uint64_t                   _batch = 0;          // last anchor batch number
+         uint64_t                   _replayed = 0;
+         std::atomic<uint64_t>      _committed{0};
+         std::atomic<uint64_t>      _rejected{0};
+         uint64_t                   _prior_committed = 0;
+         uint64_t                   _anchor_records = 0;
+         uint64_t                   _prior_syncs = 0;
+         uint64_t                   _rotations = 0;
+         uint64_t                   _batches = 0;
+         uint64_t                   _actions = 0;
+   };
+
+   bool parse_op( const dump_row& row, op& o ) {
+      const string& kind = row.get( "op" );
+      if( kind == "deposit" ) o.kind = op_deposit;
+      else if( kind == "withdraw" ) o.kind = op_withdraw;
+      else if( kind == "transfer" ) o.kind = op_transfer;
+      else return false;
+
+      dump_asset q;
+      if( !parse_asset( row.get( "quantity" ), q ) ) return false;
+      o.code = name_value( row.get( "code" ) );
+      o.symbol = symbol_raw( q );
+      o.amount = q.amount;
+      o.from = name_value( row.get( "from" ) );
+      o.to = name_value( row.get( "to" ) );
+      o.id = row.get( "id" );
+      if( o.code == 0 || (o.kind != op_deposit && o.from == 0) || o.to == 0 ) return false;
+      return !(o.kind == op_transfer && o.from == o.to);
+   }
+
+   void print_totals( const engine& e ) {
+      for( const auto& kv : e.totals() ) {
+         dump_asset a = symbol_from_raw( kv.first.second );
+         a.amount = kv.second.first;
+         std::fprintf( stderr, "%s %s across %llu ledgers\n", name_string( kv.first.first ).c_str(),
+                       a.to_string().c_str(), (unsigned long long)kv.second.second );
+      }
+   }
+
+   /**
+   * Seed accounts, push random transfers from one producer per shard and
+   * time them until committed
+   **/
+   int bench( config cfg, uint64_t accounts, uint64_t ops ) {
+      cfg.acks = false;
+      engine e( cfg );
+      e.recover();
+      e.start();
+      uint64_t seeded = e.committed() + accounts;
+
+      const uint64_t symbol = symbol_raw( dump_asset{ 0, 4, "TAP" } );
+      const uint64_t base_lgid = name_value( "bench" );
+      const int64_t seed_amount = 1000000LL * 10000;
+      std::vector<std::vector<op>> out( cfg.shards );
+      auto flush = [&]( bool all ) {
+         for( unsigned s = 0; s < cfg.shards; ++s ) {
+            if( !out[s].empty() && (all || out[s].size() >= 512) ) e.submit( s, out[s] );
+         }
+      };
+      for( uint64_t a = 0; a < accounts; ++a ) {
+         uint64_t lgid = base_lgid + a;
+         out[e.shard_of( lgid )].push_back( op{ op_deposit, cfg.tapx_code, symbol, 0, lgid, seed_amount, string() } );
+         flush( false );
+      }
+      flush( true );
+
+      while( e.committed() < seeded ) std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+
+      auto t0 = clock_type::now();
+      std::vector<std::thread> producers;
+      for( unsigned p = 0; p < cfg.shards; ++p ) {
+         producers.emplace_back( [&, p]() {
+            std::vector<std::vector<op>> mine( cfg.shards );
+            uint64_t x = mix( p + 1 );
+            uint64_t n = ops / cfg.shards + (p < ops % cfg.shards ? 1 : 0);
+            for( uint64_t i = 0; i < n; ++i ) {
+               x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+               uint64_t from = base_lgid + x % accounts;
+               uint64_t to = base_lgid + (x >> 32) % accounts;
+               if( to == from ) to = base_lgid + (to - base_lgid + 1) % accounts;
+               unsigned s = e.shard_of( from );
+               mine[s].push_back( op{ op_transfer, cfg.tapx_code, symbol, from, to, int64_t( 1 + (x >> 20) % 10000 ), string() } );
+               if( mine[s].size() >= 512 ) e.submit( s, mine[s] );
+            }
+            for( unsigned s = 0; s < cfg.shards; ++s ) if( !mine[s].empty() ) e.submit( s, mine[s] );
+         });
+      }
+      for( auto& p : producers ) p.join();
+      e.stop();
+      double secs = std::chrono::duration<double>( clock_type::now() - t0 ).count();
+
+      uint64_t done = ops - e.rejected();
+      std::fprintf( stderr, "transfers  %llu committed, %llu rejected in %.2fs with %u shards\n",
+                    (unsigned long long)done, (unsigned long long)e.rejected(), secs, cfg.shards );
+      std::fprintf( stderr, "throughput %.0f/s, %.1fM/min\n", double( done ) / secs, double( done ) / secs * 60 / 1e6 );
+      std::fprintf( stderr, "commits    %llu group syncs, %.0f records each\n", (unsigned long long)e.syncs(),
+                    double( e.committed() ) / double( std::max<uint64_t>( 1, e.syncs() ) ) );
+      std::fprintf( stderr, "anchors    %llu batches, %llu actions, %llu log rotations\n", (unsigned long long)e.batches(),
+                    (unsigned long long)e.actions(), (unsigned long long)e.rotations() );
+      print_totals( e );
+      return 0;
+   }
+
+   void usage() {
+      std::fprintf( stderr, "usage: ledgerengine --tapx ACCOUNT --dir DATA [--shards N] [--wal-mb N] [--anchor-secs N]\n"
+                            "                    [--anchor-actions N] [--opid-base N] [--bench [--accounts N] [--ops N] | --status]\n" );
+      std::exit( 2 );
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   config cfg;
+   bool run_bench = false, status = false;
+   uint64_t accounts = 100000, ops = 5000000;
+
+   for( int i = 1; i < argc; ++i ) {
+      string a = argv[i];
+      if( a == "--tapx" && i + 1 < argc )                 cfg.tapx_code = name_value( argv[++i] );
+      else if( a == "--dir" && i + 1 < argc )             cfg.dir = argv[++i];
+      else if( a == "--shards" && i + 1 < argc )          cfg.shards = unsigned( std::atoi( argv[++i] ) );
+      else if( a == "--wal-mb" && i + 1 < argc )          cfg.wal_mb = size_t( std::atoll( argv[++i] ) );
+      else if( a == "--anchor-secs" && i + 1 < argc )     cfg.anchor_secs = uint32_t( std::atoi( argv[++i] ) );
+      else if( a == "--anchor-actions" && i + 1 < argc )  cfg.anchor_actions = size_t( std::atoll( argv[++i] ) );
+      else if( a == "--opid-base" && i + 1 < argc )       cfg.opid_base = std::strtoull( argv[++i], nullptr, 10 );
+      else if( a == "--accounts" && i + 1 < argc )        accounts = std::strtoull( argv[++i], nullptr, 10 );
+      else if( a == "--ops" && i + 1 < argc )             ops = std::strtoull( argv[++i], nullptr, 10 );
+      else if( a == "--bench" )                           run_bench = true;
+      else if( a == "--status" )                          status = true;
+      else                                                usage();
+   }
+   if( cfg.tapx_code == 0 || cfg.dir.empty() || cfg.wal_mb == 0 ) usage();
+   if( cfg.shards == 0 ) cfg.shards = 1;
+   if( accounts < 2 ) accounts = 2;
+
+   try {
+      if( run_bench ) return bench( cfg, accounts, ops );
+
+      engine e( cfg );
+      e.recover();
+      if( status ) {
+         std::fprintf( stderr, "replayed %llu log records\n", (unsigned long long)e.replayed() );
+         print_totals( e );
+         return 0;
+      }
+      e.start();
+
+      string line;
+      uint64_t bad = 0;
+      dump_row row;
+      while( std::getline( std::cin, line ) ) {
+         op o;
+         if( line.empty() ) continue;
+         if( !parse_row( line.data(), line.data() + line.size(), row ) || !parse_op( row, o ) ) {
+            ++bad;
+            std::fprintf( stderr, "WARN  unparsable operation: %s\n", line.c_str() );
+            continue;
+         }
+         e.submit( std::move( o ) );
+      }
+      e.stop();
+      std::fprintf( stderr, "committed %llu, rejected %llu, unparsable %llu\n", (unsigned long long)e.committed(),
+                    (unsigned long long)e.rejected(), (unsigned long long)bad );
+   } catch( const std::exception& ex ) {
+      std::fprintf( stderr, "ERROR %s\n", ex.what() );
+      return 1;
+   }
+   return 0;
+}
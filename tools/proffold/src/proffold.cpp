@@ -0,0 +1,164 @@
+/**
+ *  proffold.cpp
+ *  copyright TAPx.io
+ *
+ *  Fold the section lines of contracts built with -DTAPX_PROFILE
+ *  (contracts/common/profile.hpp) into a per-section report.
+ *
+ *    PROF transfer;move_balance;sub_balance 1 1 0 0
+ *
+ *  Lines are picked out of anything that carries the action console: a
+ *  nodeos log with contracts-console enabled, or cleos -j output, where the
+ *  console is one JSON string with escaped newlines.
+ *
+ *  The default report lists each section path with its calls, its own db
+ *  reads, db writes, inline sends and notifications, and its inclusive
+ *  operation count, heaviest first. --folded prints "path value" lines of
+ *  the chosen metric for flamegraph.pl instead.
+ *
+ *  Build:  g++ -O2 -std=c++17 proffold.cpp -o proffold
+ *  Usage:  proffold [--folded] [--metric ops|reads|writes|sends|notifies] [log...]
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::string;
+
+namespace {
+
+   enum metric { reads = 0, writes, sends, notifies, counter_count, ops = counter_count };
+
+   struct section_totals {
+      uint64_t calls = 0;
+      uint64_t self[counter_count] = {};
+      uint64_t inclusive = 0;
+
+      uint64_t value( int m )const {
+         if( m != ops ) return self[m];
+         uint64_t v = 0;
+         for( int c = 0; c < counter_count; ++c ) v += self[c];
+         return v;
+      }
+   };
+
+   //collect the PROF lines of one input, ending at a newline or an escaped "\n"
+   void scan( const string& text, std::map<string, section_totals>& sections, uint64_t& lines ) {
+      size_t pos = 0;
+      while( (pos = text.find( "PROF ", pos )) != string::npos ) {
+         pos += 5;
+         size_t end = pos;
+         while( end < text.size() && text[end] != '\n' && text[end] != '"' &&
+                !(text[end] == '\\' && end + 1 < text.size() && text[end + 1] == 'n') ) ++end;
+         string line = text.substr( pos, end - pos );
+         pos = end;
+
+         size_t sp = line.find( ' ' );
+         if( sp == string::npos || sp == 0 ) continue;
+         uint64_t counts[counter_count];
+         const char* p = line.c_str() + sp;
+         bool ok = true;
+         for( int c = 0; c < counter_count && ok; ++c ) {
+            char* next = nullptr;
+            counts[c] = strtoull( p, &next, 10 );
+            ok = next != p;
+            p = next;
+         }
+         if( !ok ) continue;
+
+         auto& s = sections[line.substr( 0, sp )];
+         s.calls++;
+         for( int c = 0; c < counter_count; ++c ) s.self[c] += counts[c];
+         lines++;
+      }
+   }
+
+   int usage() {
+      fprintf( stderr, "usage: proffold [--folded] [--metric ops|reads|writes|sends|notifies] [log...]\n" );
+      return 2;
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   bool folded = false;
+   int m = ops;
+   std::vector<string> files;
+   for( int i = 1; i < argc; ++i ) {
+      string arg = argv[i];
+      if( arg == "--folded" ) {
+         folded = true;
+      } else if( arg == "--metric" && i + 1 < argc ) {
+         static const char* names[] = { "reads", "writes", "sends", "notifies", "ops" };
+         string name = argv[++i];
+         m = -1;
+         for( int n = 0; n <= ops; ++n ) if( name == names[n] ) m = n;
+         if( m < 0 ) return usage();
+      } else if( arg.size() > 1 && arg[0] == '-' ) {
+         return usage();
+      } else {
+         files.push_back( arg );
+      }
+   }
+
+   std::map<string, section_totals> sections;
+   uint64_t lines = 0;
+   if( files.empty() ) {
+      string text( (std::istreambuf_iterator<char>( std::cin )), std::istreambuf_iterator<char>() );
+      scan( text, sections, lines );
+   }
+   for( const auto& f : files ) {
+      std::ifstream in( f );
+      if( !in ) {
+         fprintf( stderr, "proffold: cannot open %s\n", f.c_str() );
+         return 1;
+      }
+      string text( (std::istreambuf_iterator<char>( in )), std::istreambuf_iterator<char>() );
+      scan( text, sections, lines );
+   }
+   if( lines == 0 ) {
+      fprintf( stderr, "proffold: no PROF lines found, was the contract built with -DTAPX_PROFILE?\n" );
+      return 1;
+   }
+
+   if( folded ) {
+      for( const auto& s : sections ) {
+         uint64_t v = s.second.value( m );
+         if( v ) printf( "%s %llu\n", s.first.c_str(), (unsigned long long)v );
+      }
+      return 0;
+   }
+
+   //a path's inclusive count adds every path below it, which sorts right after it
+   for( auto it = sections.begin(); it != sections.end(); ++it ) {
+      string prefix = it->first + ";";
+      it->second.inclusive = it->second.value( m );
+      for( auto below = std::next( it ); below != sections.end() &&
+           below->first.compare( 0, prefix.size(), prefix ) == 0; ++below ) {
+         it->second.inclusive += below->second.value( m );
+      }
+   }
+
+   std::vector<std::pair<string, section_totals>> rows( sections.begin(), sections.end() );
+   std::stable_sort( rows.begin(), rows.end(), []( const auto& a, const auto& b ) {
+      return a.second.inclusive > b.second.inclusive;
+   });
+
+   printf( "%10s %8s %8s %8s %8s %10s %9s  %s\n", "calls", "reads", "writes", "sends", "notifies",
+           "inclusive", "per call", "section" );
+   for( const auto& r : rows ) {
+      const auto& s = r.second;
+      printf( "%10llu %8llu %8llu %8llu %8llu %10llu %9.2f  %s\n", (unsigned long long)s.calls,
+              (unsigned long long)s.self[reads], (unsigned long long)s.self[writes],
+              (unsigned long long)s.self[sends], (unsigned long long)s.self[notifies],
+              (unsigned long long)s.inclusive, double( s.inclusive ) / double( s.calls ), r.first.c_str() );
+   }
+   return 0;
+}
@@ -0,0 +1,1331 @@
+/**
+ *  replayer.cpp
+ *  copyright TAPx.io
+ *
+ *  Rebuild the tables of tapx, brandedtoken and tapxdgoods natively from
+ *  their recorded action history, to bootstrap an indexer or read replica
+ *  without replaying the chain through nodeos.
+ *
+ *  The log holds one executed action per line in execution order, as
+ *  exported from state history or an action indexer, e.g.
+ *
+ *    {"timestamp":"2019-05-01T12:00:00.000","receiver":"tapatalktpx1",
+ *     "act":{"account":"tapatalktpx1","name":"transfer","data":{"from":"alice",...}}}
+ *
+ *  act.account/account, act.name/name and act.data/data are both accepted,
+ *  the time is "timestamp" or "block_time". Notifications (receiver other
+ *  than the account) are skipped, except token transfers received by
+ *  tapxdgoods, which are its purchases. Inline actions are applied as their
+ *  own lines, so each action only applies its direct table changes. Only
+ *  executed actions are logged, so a failed precondition during replay means
+ *  the log and the model disagree and is reported as an error.
+ *
+ *  Every table row change is an effect on one row key. Lines are parsed in
+ *  parallel batches, a dispatcher turns each action into effects in log
+ *  order, and the effects are applied by workers that each own the rows
+ *  hashing to them. A transfer's debit and credit are therefore handed to
+ *  the owners of the two rows, and each owner still applies them in log
+ *  order. State that decides what an action does before any row changes
+ *  (operation id dedup, streams, holds, community ledger ids) and all of
+ *  tapxdgoods, whose tables share one scope and low volume, stay with the
+ *  dispatcher.
+ *
+ *  The ledger tiers (hot, cold, legacy) are one logical balance per ledger
+ *  here, and activity buckets, which are derived statistics, are not
+ *  rebuilt. The snapshot is a table dump, so custodyaudit reads it as well.
+ *  After the replay it is checked for supply and custody conservation, and
+ *  --verify compares it with a dump of the chain tables.
+ *
+ *  Build:  g++ -O2 -std=c++17 -pthread replayer.cpp -o replayer
+ *  Usage:  replayer --tapx ACCOUNT [--brand ACCOUNT]... [--goods ACCOUNT] [--threads N]
+ *                   [--rate N] [--out snapshot.jsonl] [--verify DUMP]... LOG...
+ */
+#include "../../common/tabledump.hpp"
+#include "../../../contracts/common/decay.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace tapx;
+
+namespace {
+
+   typedef __int128 int128;
+
+   constexpr uint64_t nm( const char* s ) {
+      uint64_t v = 0;
+      for( uint32_t i = 0; s[i] && i < 12; ++i ) {
+         char c = s[i];
+         uint64_t sym = (c >= 'a' && c <= 'z') ? uint64_t( c - 'a' ) + 6 : (c >= '1' && c <= '5') ? uint64_t( c - '1' ) + 1 : 0;
+         v |= (sym & 0x1f) << (64 - 5 * (i + 1));
+      }
+      return v;
+   }
+
+   //contract constants the replay must agree with
+   static constexpr uint32_t ledger_op_window = 2 * 3600;
+   static constexpr uint32_t ledger_op_prune_batch = 2;
+   static constexpr uint64_t custody_stripes = 16;
+   static constexpr uint32_t voucher_close_batch = 256;
+
+   //custody.hpp custody_stripe_of
+   uint64_t custody_stripe_of( uint64_t lgid ) { return (lgid * 0x9e3779b97f4a7c15ULL) >> 60; }
+   static_assert( custody_stripes == 16, "custody_stripe_of takes 4 bits" );
+
+   enum contract_kind : uint8_t { c_none = 0, c_tapx, c_brand, c_goods };
+
+   enum table_id : uint8_t {
+      t_accounts = 0,
+      t_stat,
+      t_ledger,
+      t_custody,
+      t_brandregs,
+      t_brands,
+      t_reputations,
+      t_cledgers
+   };
+
+   struct row_key {
+      uint64_t code;
+      uint64_t scope;
+      uint64_t pk;
+      uint64_t pk2;
+      uint8_t  table;
+
+      bool operator==( const row_key& o )const {
+         return code == o.code && scope == o.scope && pk == o.pk && pk2 == o.pk2 && table == o.table;
+      }
+      bool operator<( const row_key& o )const {
+         if( code != o.code ) return code < o.code;
+         if( table != o.table ) return table < o.table;
+         if( scope != o.scope ) return scope < o.scope;
+         if( pk != o.pk ) return pk < o.pk;
+         return pk2 < o.pk2;
+      }
+   };
+
+   inline uint64_t mix( uint64_t h ) {
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+      return h ^ (h >> 31);
+   }
+
+   struct row_hash {
+      size_t operator()( const row_key& k )const {
+         return size_t( mix( k.code ^ mix( k.scope ^ mix( k.pk ^ mix( k.pk2 ^ k.table ) ) ) ) );
+      }
+   };
+
+   //one table row; which fields mean what depends on the table
+   struct row {
+      int64_t  a = 0;     // balance, amount, supply, staked, or score bits
+      int64_t  b = 0;     // max_supply, or the brand symbol of a registration
+      uint64_t c = 0;     // issuer, contract, supply_auth, or updated
+      uint64_t d = 0;     // staker or community ledger id
+      uint64_t sym = 0;   // raw symbol of a and b
+   };
+
+   enum op_kind : uint8_t {
+      op_credit,            // a += v, opening the row if missing
+      op_credit_existing,   // a += v, the row must exist
+      op_debit,             // a -= v, the row must exist and cover v
+      op_adjust,            // a += v, opening the row, may go negative
+      op_open,              // open with a = 0 if missing
+      op_close,             // erase, the row must hold a = 0
+      op_create,            // open with a = 0 and d = y, the row must not exist
+      op_stat_create,       // open a stat row, max supply v and issuer x
+      op_supply,            // supply += v, within 0..max supply
+      op_max_supply,        // max supply += v, not below supply
+      op_set,               // c = x, d = y and b = v if nonzero, opening the row
+      op_repute             // decay the score to time x, then add v
+   };
+
+   struct effect {
+      row_key  key;
+      uint64_t line;
+      uint64_t x;
+      uint64_t y;
+      int64_t  v;
+      uint64_t sym;
+      op_kind  op;
+   };
+
+   struct failure {
+      uint64_t line;
+      string   what;
+
+      bool operator<( const failure& o )const { return line < o.line; }
+   };
+
+   typedef std::unordered_map<row_key, row, row_hash> row_store;
+
+   const char* apply( row_store& rows, const effect& e ) {
+      auto it = rows.find( e.key );
+      bool found = it != rows.end();
+      auto open = [&]() -> row& {
+         row& r = rows[e.key];
+         r.sym = e.sym;
+         return r;
+      };
+      switch( e.op ) {
+         case op_credit:
+         case op_adjust: {
+            row& r = found ? it->second : open();
+            r.a += e.v;
+            return nullptr;
+         }
+         case op_credit_existing:
+            if( !found ) return "row does not exist";
+            it->second.a += e.v;
+            return nullptr;
+         case op_debit:
+            if( !found ) return "row does not exist";
+            if( it->second.a < e.v ) return "overdrawn balance";
+            it->second.a -= e.v;
+            return nullptr;
+         case op_open:
+            if( !found ) open();
+            return nullptr;
+         case op_close:
+            if( !found ) return "row does not exist";
+            if( it->second.a != 0 ) return "closing a non-zero balance";
+            rows.erase( it );
+            return nullptr;
+         case op_create: {
+            if( found ) return "row already exists";
+            open().d = e.y;
+            return nullptr;
+         }
+         case op_stat_create: {
+            if( found ) return "token with symbol already exists";
+            row& r = open();
+            r.b = e.v;
+            r.c = e.x;
+            return nullptr;
+         }
+         case op_supply: {
+            if( !found ) return "token with symbol does not exist";
+            int64_t supply = it->second.a + e.v;
+            if( supply < 0 || supply > it->second.b ) return "supply outside 0..max_supply";
+            it->second.a = supply;
+            return nullptr;
+         }
+         case op_max_supply: {
+            if( !found ) return "token with symbol does not exist";
+            int64_t max = it->second.b + e.v;
+            if( max < it->second.a ) return "max_supply below supply";
+            it->second.b = max;
+            return nullptr;
+         }
+         case op_set: {
+            row& r = found ? it->second : open();
+            r.c = e.x;
+            r.d = e.y;
+            if( e.v ) r.b = e.v;
+            return nullptr;
+         }
+         case op_repute: {
+            row& r = found ? it->second : open();
+            uint64_t score = found ? eosio::add_score( eosio::decay_score( uint64_t( r.a ), uint32_t( e.x ) - uint32_t( r.c ),
+                                                                          eosio::reputation_half_life ), uint64_t( e.v ) )
+                                   : uint64_t( e.v );
+            r.a = int64_t( score );
+            r.c = e.x;
+            return nullptr;
+         }
+      }
+      return "unknown effect";
+   }
+
+   //parse "2019-05-01T12:00:00.000" or seconds as block time in seconds
+   uint32_t parse_time( const string& s ) {
+      if( s.size() < 19 || s[4] != '-' ) return uint32_t( std::strtoul( s.c_str(), nullptr, 10 ) );
+      int y = std::atoi( s.substr( 0, 4 ).c_str() ), m = std::atoi( s.substr( 5, 2 ).c_str() ), d = std::atoi( s.substr( 8, 2 ).c_str() );
+      int hh = std::atoi( s.substr( 11, 2 ).c_str() ), mm = std::atoi( s.substr( 14, 2 ).c_str() ), ss = std::atoi( s.substr( 17, 2 ).c_str() );
+      //days from civil, proleptic Gregorian
+      y -= m <= 2;
+      int era = (y >= 0 ? y : y - 399) / 400;
+      unsigned yoe = unsigned( y - era * 400 );
+      unsigned doy = unsigned( (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1 );
+      unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+      int64_t days = int64_t( era ) * 146097 + int64_t( doe ) - 719468;
+      return uint32_t( days * 86400 + hh * 3600 + mm * 60 + ss );
+   }
+
+   //"4,GDP" to a raw symbol
+   uint64_t parse_symbol( const string& s ) {
+      size_t comma = s.find( ',' );
+      if( comma == string::npos ) return 0;
+      dump_asset a;
+      a.precision = uint8_t( std::atoi( s.substr( 0, comma ).c_str() ) );
+      a.symbol = s.substr( comma + 1 );
+      return symbol_raw( a );
+   }
+
+   string symbol_string( uint64_t raw ) {
+      dump_asset a = symbol_from_raw( raw );
+      return std::to_string( a.precision ) + "," + a.symbol;
+   }
+
+   string asset_string( int64_t amount, uint64_t raw ) {
+      dump_asset a = symbol_from_raw( raw );
+      a.amount = amount;
+      return a.to_string();
+   }
+
+   string quote( const string& s ) {
+      string out = "\"";
+      for( unsigned char c : s ) {
+         if( c == '"' || c == '\\' ) { out += '\\'; out += char(c); }
+         else if( c == '\n' ) out += "\\n";
+         else if( c < 0x20 ) { char buf[8]; std::snprintf( buf, sizeof(buf), "\\u%04x", c ); out += buf; }
+         else out += char(c);
+      }
+      return out + "\"";
+   }
+
+   //one parsed log line with the prefix its fields use
+   struct log_line {
+      dump_row   row;
+      const char* data = "data.";
+      uint64_t   code = 0;
+      uint64_t   name = 0;
+      uint64_t   notifier = 0;   // token contract of a transfer notification
+      uint32_t   time = 0;
+      uint64_t   line = 0;
+      bool       keep = false;
+
+      const string& arg( const char* k )const { return row.get( (string( data ) + k).c_str() ); }
+      uint64_t name_arg( const char* k )const { return name_value( arg( k ) ); }
+      uint64_t num_arg( const char* k )const { return std::strtoull( arg( k ).c_str(), nullptr, 10 ); }
+      uint64_t symbol_arg( const char* k )const { return parse_symbol( arg( k ) ); }
+      bool asset_arg( const char* k, int64_t& amount, uint64_t& sym )const {
+         dump_asset a;
+         if( !parse_asset( arg( k ), a ) ) return false;
+         amount = a.amount;
+         sym = symbol_raw( a );
+         return true;
+      }
+      bool has( const char* k )const { return row.find( (string( data ) + k).c_str() ) != nullptr; }
+   };
+
+   struct stream_row {
+      uint64_t payer, payee;
+      int64_t  deposit, withdrawn;
+      uint32_t start, end;
+
+      int64_t vested( uint32_t t )const {
+         if( t <= start ) return 0;
+         if( t >= end ) return deposit;
+         return int64_t( (unsigned __int128)deposit * (t - start) / (end - start) );
+      }
+   };
+
+   //brandedtoken holds of one symbol, pruned like held_amount when their ledger is debited
+   struct hold_state {
+      struct hold_row { uint64_t lgid; int64_t amount; uint32_t expires; };
+
+      std::map<uint64_t, hold_row>                          byid;
+      std::set<std::tuple<uint64_t, uint32_t, uint64_t>>    byledger;   // lgid, expires, id
+
+      void erase( std::map<uint64_t, hold_row>::iterator it ) {
+         byledger.erase( std::make_tuple( it->second.lgid, it->second.expires, it->first ) );
+         byid.erase( it );
+      }
+
+      void expire( uint64_t lgid, uint32_t t ) {
+         auto it = byledger.lower_bound( std::make_tuple( lgid, uint32_t( 0 ), uint64_t( 0 ) ) );
+         while( it != byledger.end() && std::get<0>( *it ) == lgid && std::get<1>( *it ) <= t ) {
+            byid.erase( std::get<2>( *it ) );
+            it = byledger.erase( it );
+         }
+      }
+   };
+
+   struct dedup_state {
+      std::unordered_set<uint64_t>            ids;
+      std::set<std::pair<uint32_t, uint64_t>> byexpires;
+
+      bool claim( uint64_t opid, uint32_t t ) {
+         if( opid == 0 ) return true;
+         if( ids.count( opid ) ) return false;
+         auto it = byexpires.begin();
+         for( uint32_t n = 0; n < ledger_op_prune_batch && it != byexpires.end() && it->first <= t; ++n ) {
+            ids.erase( it->second );
+            it = byexpires.erase( it );
+         }
+         ids.insert( opid );
+         byexpires.emplace( t + ledger_op_window, opid );
+         return true;
+      }
+   };
+
+   //tapxdgoods tables
+   struct goods_state {
+      struct stats { uint64_t issuer; bool fungible, burnable, transferable; uint64_t max_supply; uint8_t precision; uint64_t current_supply; };
+      struct item { uint64_t owner, token_name; string metadata_type, metadata_uri, metadata; bool has_metadata; };
+      struct listing { uint64_t seller, token_name, token_contract; int64_t price; uint64_t price_sym; };
+      struct voucher { uint64_t token_name; uint32_t count, claimed; bool closed; string root, metadata_type, metadata_uri; std::set<uint64_t> words; };
+
+      std::map<uint64_t, stats>     tokenstats;
+      std::map<uint64_t, item>      tokeninfo;
+      std::map<uint64_t, listing>   listings;
+      std::set<std::tuple<uint64_t, uint64_t, uint64_t, uint64_t, uint64_t>> byprice;   // token_name, token contract, price symbol, amount, serial
+      std::map<uint64_t, voucher>   vouchers;
+      bool                          serials_exist = false;
+      uint64_t                      next_serial = 0;
+
+      uint64_t reserve_serials( uint64_t count ) {
+         if( !serials_exist ) {
+            next_serial = tokeninfo.empty() ? 0 : tokeninfo.rbegin()->first + 1;
+            serials_exist = true;
+         }
+         uint64_t first = next_serial;
+         next_serial += count;
+         return first;
+      }
+   };
+
+   class replayer {
+      public:
+         replayer( unsigned threads, int64_t rate ) : _threads( threads ), _rate( rate ), _stores( threads ), _failures( threads ) {}
+
+         void add_code( uint64_t code, contract_kind kind ) { _codes[code] = kind; }
+
+         void replay( const string& path );
+         uint64_t actions()const { return _actions; }
+         uint64_t lines()const { return _lines; }
+
+         std::vector<failure> failures()const {
+            std::vector<failure> all = _dispatch_failures;
+            for( const auto& f : _failures ) all.insert( all.end(), f.begin(), f.end() );
+            std::sort( all.begin(), all.end() );
+            return all;
+         }
+
+         void write_snapshot( FILE* out )const;
+         uint64_t check_invariants()const;
+
+      private:
+         void parse( log_line& l, const char* begin, const char* end )const;
+         void dispatch( const log_line& l );
+         void dispatch_goods( const log_line& l );
+         void apply_batch();
+
+         void emit( const log_line& l, uint8_t table, uint64_t scope, uint64_t pk, op_kind op, int64_t v, uint64_t sym,
+                    uint64_t x = 0, uint64_t y = 0, uint64_t pk2 = 0 ) {
+            effect e{ row_key{ l.code, scope, pk, pk2, table }, l.line, x, y, v, sym, op };
+            _pending[row_hash()( e.key ) % _threads].push_back( e );
+         }
+         void fail( const log_line& l, const string& what ) { _dispatch_failures.push_back( failure{ l.line, what } ); }
+
+         //the shared balance paths of both token contracts
+         void debit_account( const log_line& l, uint64_t owner, int64_t amount, uint64_t sym ) {
+            emit( l, t_accounts, owner, sym >> 8, op_debit, amount, sym );
+         }
+         void credit_account( const log_line& l, uint64_t owner, int64_t amount, uint64_t sym ) {
+            emit( l, t_accounts, owner, sym >> 8, op_credit, amount, sym );
+         }
+         void custody( const log_line& l, uint64_t lgid, int64_t amount, uint64_t sym ) {
+            emit( l, t_custody, sym, custody_stripe_of( lgid ), op_adjust, amount, sym );
+         }
+         void ledger( const log_line& l, uint64_t lgid, op_kind op, int64_t amount, uint64_t sym ) {
+            if( op == op_debit ) {
+               auto h = _holds.find( { l.code, sym } );
+               if( h != _holds.end() ) h->second.expire( lgid, l.time );
+            }
+            emit( l, t_ledger, sym, lgid, op, amount, sym );
+         }
+         //community ledger credit, opening the row with the next primary key like add_cid
+         void credit_cid( const log_line& l, uint64_t community, uint64_t user, int64_t amount, uint64_t sym ) {
+            auto& ids = _cids[l.code];
+            if( ids.emplace( std::make_tuple( community, user, sym ), ids.size() ).second ) {
+               emit( l, t_cledgers, sym, community, op_create, 0, sym, 0, ids.size() - 1, user );
+            }
+            emit( l, t_cledgers, sym, community, op_credit_existing, amount, sym, 0, 0, user );
+         }
+         bool token_action( const log_line& l );
+
+         unsigned                                     _threads;
+         int64_t                                      _rate;
+         std::map<uint64_t, contract_kind>            _codes;
+         std::vector<row_store>                       _stores;
+         std::vector<std::vector<failure>>            _failures;
+         std::vector<failure>                         _dispatch_failures;
+         std::vector<std::vector<effect>>             _pending;
+
+         std::map<std::pair<uint64_t, uint64_t>, uint64_t>                    _issuers;    // code, symbol name
+         std::map<std::pair<uint64_t, uint64_t>, int64_t>                     _max_supplies; // brand code, symbol name
+         std::set<std::pair<uint64_t, uint64_t>>                               _brandregs;  // tapx code, symbol name
+         std::map<uint64_t, dedup_state>                                       _dedup;
+         std::map<std::pair<uint64_t, uint64_t>, std::map<uint64_t, stream_row>> _streams; // code, raw symbol
+         std::map<std::pair<uint64_t, uint64_t>, hold_state>                   _holds;      // code, raw symbol
+         std::map<uint64_t, std::map<std::tuple<uint64_t, uint64_t, uint64_t>, uint64_t>> _cids;  // code; community, user, raw symbol
+         std::map<uint64_t, goods_state>                                       _goods;
+         uint64_t                                                              _actions = 0;
+         uint64_t                                                              _lines = 0;
+   };
+
+   void replayer::parse( log_line& l, const char* begin, const char* end )const {
+      l.keep = false;
+      if( !parse_row( begin, end, l.row ) ) return;
+      const string* account = l.row.find( "act.account" );
+      const char* prefix = "act.data.";
+      const string* name = l.row.find( "act.name" );
+      if( !account ) {
+         account = l.row.find( "account" );
+         name = l.row.find( "name" );
+         prefix = "data.";
+      }
+      if( !account || !name ) return;
+      l.code = name_value( *account );
+      l.name = name_value( *name );
+      l.notifier = 0;
+      const string* receiver = l.row.find( "receiver" );
+      uint64_t recv = receiver && !receiver->empty() ? name_value( *receiver ) : l.code;
+      if( recv != l.code ) {
+         //notifications replay nothing, the receiving contract's own line does, except
+         //token transfers to tapxdgoods, which settle its purchases
+         auto goods = _codes.find( recv );
+         if( goods == _codes.end() || goods->second != c_goods || l.name != nm( "transfer" ) ) return;
+         l.notifier = l.code;
+         l.code = recv;
+         l.name = nm( "onpayment" );
+      }
+      if( !_codes.count( l.code ) ) return;
+
+      l.data = prefix;
+      const string* t = l.row.find( "timestamp" );
+      if( !t ) t = l.row.find( "block_time" );
+      l.time = t ? parse_time( *t ) : 0;
+      l.keep = true;
+   }
+
+   bool replayer::token_action( const log_line& l ) {
+      int64_t amount;
+      uint64_t sym;
+      switch( l.name ) {
+         case nm( "issue" ): {
+            if( !l.asset_arg( "quantity", amount, sym ) ) break;
+            auto issuer = _issuers.find( { l.code, sym >> 8 } );
+            if( issuer == _issuers.end() ) { fail( l, "issue of a token without stat row" ); return true; }
+            emit( l, t_stat, sym >> 8, sym >> 8, op_supply, amount, sym );
+            credit_account( l, issuer->second, amount, sym );
+            return true;
+         }
+         case nm( "retire" ): {
+            if( !l.asset_arg( "quantity", amount, sym ) ) break;
+            auto issuer = _issuers.find( { l.code, sym >> 8 } );
+            if( issuer == _issuers.end() ) { fail( l, "retire of a token without stat row" ); return true; }
+            emit( l, t_stat, sym >> 8, sym >> 8, op_supply, -amount, sym );
+            debit_account( l, issuer->second, amount, sym );
+            return true;
+         }
+         case nm( "transfer" ):
+            if( !l.asset_arg( "quantity", amount, sym ) ) break;
+            debit_account( l, l.name_arg( "from" ), amount, sym );
+            credit_account( l, l.name_arg( "to" ), amount, sym );
+            return true;
+         case nm( "open" ):
+            sym = l.symbol_arg( "symbol" );
+            emit( l, t_accounts, l.name_arg( "owner" ), sym >> 8, op_open, 0, sym );
+            return true;
+         case nm( "close" ):
+            sym = l.symbol_arg( "symbol" );
+            emit( l, t_accounts, l.name_arg( "owner" ), sym >> 8, op_close, 0, sym );
+            return true;
+         case nm( "createlgid" ): {
+            bool tapx = _codes[l.code] == c_tapx;
+            sym = tapx ? symbol_raw( dump_asset{ 0, 4, "TAP" } ) : l.symbol_arg( "symbolo" );
+            ledger( l, l.name_arg( tapx ? "ledger_id" : "lgid" ), op_create, 0, sym );
+            return true;
+         }
+         case nm( "migrate" ):
+         case nm( "demote" ):
+         case nm( "getbalances" ):
+            //tier moves and reads, the logical ledger balance is unchanged
+            return true;
+      }
+      return false;
+   }
+
+   void replayer::dispatch( const log_line& l ) {
+      ++_actions;
+      contract_kind kind = _codes[l.code];
+      if( kind == c_goods ) { dispatch_goods( l ); return; }
+      if( token_action( l ) ) return;
+
+      int64_t amount;
+      uint64_t sym;
+      const uint64_t self = l.code;
+      const bool tapx = kind == c_tapx;
+      switch( l.name ) {
+         case nm( "create" ): {
+            int64_t max;
+            if( tapx ) {
+               if( !l.asset_arg( "maximum_supply", max, sym ) ) break;
+            } else {
+               //brandedtoken::create seeds 1 unit of max supply
+               sym = l.symbol_arg( "symbolo" );
+               max = 1;
+               _max_supplies[{ l.code, sym >> 8 }] = max;
+            }
+            uint64_t issuer = l.name_arg( "issuer" );
+            emit( l, t_stat, sym >> 8, sym >> 8, op_stat_create, max, sym, issuer );
+            _issuers.emplace( std::make_pair( l.code, sym >> 8 ), issuer );
+            return;
+         }
+         case nm( "depledger" ):
+         case nm( "depbtoken" ): {
+            if( !l.asset_arg( "quantity", amount, sym ) ) break;
+            uint64_t from = l.name_arg( tapx ? "tapx_from" : "btoken_from" );
+            uint64_t lgid = l.name_arg( tapx ? "ledger_to" : "lgid_to" );
+            debit_account( l, from, amount, sym );
+            custody( l, lgid, amount, sym );
+            ledger( l, lgid, op_credit, amount, sym );
+            return;
+         }
+         case nm( "wdrledger" ):
+         case nm( "wdrbtoken" ): {
+            if( !l.asset_arg( "quantity", amount, sym ) ) break;
+            if( !_dedup[l.code].claim( l.num_arg( "opid" ), l.time ) ) return;
+            uint64_t lgid = l.name_arg( tapx ? "ledger_from" : "lgid_from" );
+            ledger( l, lgid, op_debit, amount, sym );
+            custody( l, lgid, -amount, sym );
+            credit_account( l, l.name_arg( tapx ? "tapx_to" : "btoken_to" ), amount, sym );
+            return;
+         }
+         case nm( "trfledger" ):
+         case nm( "trfbtoken" ): {
+            if( !l.asset_arg( "quantity", amount, sym ) ) break;
+            uint64_t from = l.name_arg( tapx ? "ledger_from" : "lgid_from" );
+            uint64_t to = l.name_arg( tapx ? "ledger_to" : "lgid_to" );
+            if( from == to ) { fail( l, "cannot transfer to self" ); return; }
+            if( !_dedup[l.code].claim( l.num_arg( "opid" ), l.time ) ) return;
+            ledger( l, from, op_debit, amount, sym );
+            ledger( l, to, op_credit, amount, sym );
+            emit( l, t_reputations, sym >> 8, to, op_repute, amount, sym, l.time );
+            return;
+         }
+      }
+
+      if( tapx ) {
+         switch( l.name ) {
+            case nm( "regbrand" ): {
+               uint64_t brand = l.symbol_arg( "symbol" );
+               uint64_t contract = l.name_arg( "contract" );
+               uint64_t tap = symbol_raw( dump_asset{ 0, 4, "TAP" } );
+               emit( l, t_brandregs, self, brand >> 8, op_set, int64_t( brand ), tap, contract, l.name_arg( "staker" ) );
+               //a first registration seeds staked from the max supply the brand already has
+               if( _brandregs.insert( { self, brand >> 8 } ).second ) {
+                  auto max = _max_supplies.find( { contract, brand >> 8 } );
+                  if( max != _max_supplies.end() && max->second > 1 ) {
+                     emit( l, t_brandregs, self, brand >> 8, op_credit_existing, (max->second - 1) / _rate, tap );
+                  }
+               }
+               return;
+            }
+            case nm( "stake" ): {
+               if( !l.asset_arg( "quantity", amount, sym ) ) break;
+               uint64_t account = l.name_arg( "account" );
+               debit_account( l, account, amount, sym );
+               credit_account( l, self, amount, sym );
+               emit( l, t_brandregs, self, l.symbol_arg( "symbol" ) >> 8, op_credit_existing, amount, sym );
+               return;
+            }
+            case nm( "unstake" ): {
+               uint64_t brand;
+               if( !l.asset_arg( "quantity", amount, brand ) ) break;
+               sym = l.symbol_arg( "symbol" );
+               int64_t tap = amount / _rate;
+               uint64_t account = l.name_arg( "account" );
+               emit( l, t_brandregs, self, brand >> 8, op_debit, tap, sym );
+               debit_account( l, self, tap, sym );
+               credit_account( l, account, tap, sym );
+               return;
+            }
+         }
+      } else {
+         switch( l.name ) {
+            case nm( "mint" ): {
+               sym = l.symbol_arg( "symbolo" );
+               int64_t total = 0;
+               for( uint32_t i = 0; l.has( ("accounts." + std::to_string( i ) + ".to").c_str() ); ++i ) {
+                  string p = "accounts." + std::to_string( i ) + ".";
+                  amount = std::strtoll( l.arg( (p + "amount").c_str() ).c_str(), nullptr, 10 );
+                  credit_account( l, l.name_arg( (p + "to").c_str() ), amount, sym );
+                  total += amount;
+               }
+               for( uint32_t i = 0; l.has( ("lgids." + std::to_string( i ) + ".to").c_str() ); ++i ) {
+                  string p = "lgids." + std::to_string( i ) + ".";
+                  amount = std::strtoll( l.arg( (p + "amount").c_str() ).c_str(), nullptr, 10 );
+                  uint64_t lgid = l.name_arg( (p + "to").c_str() );
+                  ledger( l, lgid, op_credit, amount, sym );
+                  custody( l, lgid, amount, sym );
+                  total += amount;
+               }
+               emit( l, t_stat, sym >> 8, sym >> 8, op_supply, total, sym );
+               return;
+            }
+            case nm( "setbrand" ):
+               sym = l.symbol_arg( "symbolo" );
+               emit( l, t_brands, sym >> 8, sym >> 8, op_set, 0, sym, l.name_arg( "supplyauth" ) );
+               return;
+            case nm( "addsupply" ):
+            case nm( "subsupply" ):
+               if( !l.asset_arg( "quantity", amount, sym ) ) break;
+               _max_supplies[{ l.code, sym >> 8 }] += l.name == nm( "addsupply" ) ? amount : -amount;
+               emit( l, t_stat, sym >> 8, sym >> 8, op_max_supply, l.name == nm( "addsupply" ) ? amount : -amount, sym );
+               return;
+            case nm( "createcid" ): {
+               sym = l.symbol_arg( "symbolo" );
+               uint64_t community = l.num_arg( "lgid.community" ), user = l.num_arg( "lgid.user" );
+               auto& ids = _cids[l.code];
+               //rows are never erased, available_primary_key is the count
+               if( !ids.emplace( std::make_tuple( community, user, sym ), ids.size() ).second ) { fail( l, "ledger ID already exists" ); return; }
+               emit( l, t_cledgers, sym, community, op_create, 0, sym, 0, ids.size() - 1, user );
+               return;
+            }
+            case nm( "depcid" ): {
+               if( !l.asset_arg( "quantity", amount, sym ) ) break;
+               uint64_t community = l.num_arg( "lgid_to.community" ), user = l.num_arg( "lgid_to.user" );
+               debit_account( l, l.name_arg( "btoken_from" ), amount, sym );
+               custody( l, user, amount, sym );
+               credit_cid( l, community, user, amount, sym );
+               return;
+            }
+            case nm( "wdrcid" ): {
+               if( !l.asset_arg( "quantity", amount, sym ) ) break;
+               if( !_dedup[l.code].claim( l.num_arg( "opid" ), l.time ) ) return;
+               uint64_t community = l.num_arg( "lgid_from.community" ), user = l.num_arg( "lgid_from.user" );
+               emit( l, t_cledgers, sym, community, op_debit, amount, sym, 0, 0, user );
+               custody( l, user, -amount, sym );
+               credit_account( l, l.name_arg( "btoken_to" ), amount, sym );
+               return;
+            }
+            case nm( "trfcid" ): {
+               if( !l.asset_arg( "quantity", amount, sym ) ) break;
+               uint64_t from_community = l.num_arg( "lgid_from.community" ), from_user = l.num_arg( "lgid_from.user" );
+               uint64_t to_community = l.num_arg( "lgid_to.community" ), to_user = l.num_arg( "lgid_to.user" );
+               if( from_community == to_community && from_user == to_user ) { fail( l, "cannot transfer to self" ); return; }
+               if( !_dedup[l.code].claim( l.num_arg( "opid" ), l.time ) ) return;
+               emit( l, t_cledgers, sym, from_community, op_debit, amount, sym, 0, 0, from_user );
+               credit_cid( l, to_community, to_user, amount, sym );
+               return;
+            }
+            case nm( "hold" ): {
+               if( !l.asset_arg( "quantity", amount, sym ) ) break;
+               uint64_t lgid = l.name_arg( "lgid" ), holdid = l.num_arg( "holdid" );
+               uint32_t expires = uint32_t( l.num_arg( "expires" ) );
+               hold_state& h = _holds[{ l.code, sym }];
+               h.expire( lgid, l.time );
+               if( h.byid.count( holdid ) ) { fail( l, "hold ID already exists" ); return; }
+               h.byid[holdid] = hold_state::hold_row{ lgid, amount, expires };
+               h.byledger.emplace( lgid, expires, holdid );
+               return;
+            }
+            case nm( "capture" ): {
+               sym = l.symbol_arg( "symbolo" );
+               hold_state& h = _holds[{ l.code, sym }];
+               //recipient, amount, reputation points
+               std::vector<std::tuple<uint64_t, int64_t, int64_t>> credits;
+               for( uint32_t i = 0; l.has( ("captures." + std::to_string( i ) + ".holdid").c_str() ); ++i ) {
+                  string p = "captures." + std::to_string( i ) + ".";
+                  auto it = h.byid.find( l.num_arg( (p + "holdid").c_str() ) );
+                  if( it == h.byid.end() ) continue;
+                  bool live = it->second.expires > l.time;
+                  uint64_t lgid = it->second.lgid;
+                  h.erase( it );
+                  if( !live ) continue;
+
+                  amount = std::strtoll( l.arg( (p + "amount").c_str() ).c_str(), nullptr, 10 );
+                  uint64_t to = l.name_arg( (p + "lgid_to").c_str() );
+                  ledger( l, lgid, op_debit, amount, sym );
+                  int64_t points = to == lgid ? 0 : amount;
+                  auto cr = std::find_if( credits.begin(), credits.end(), [&]( const auto& c ) { return std::get<0>( c ) == to; } );
+                  if( cr == credits.end() ) credits.emplace_back( to, amount, points );
+                  else {
+                     std::get<1>( *cr ) += amount;
+                     std::get<2>( *cr ) += points;
+                  }
+               }
+               for( const auto& cr : credits ) {
+                  ledger( l, std::get<0>( cr ), op_credit, std::get<1>( cr ), sym );
+                  if( std::get<2>( cr ) > 0 ) emit( l, t_reputations, sym >> 8, std::get<0>( cr ), op_repute, std::get<2>( cr ), sym, l.time );
+               }
+               return;
+            }
+            case nm( "release" ): {
+               sym = l.symbol_arg( "symbolo" );
+               hold_state& h = _holds[{ l.code, sym }];
+               for( uint32_t i = 0; l.has( ("holdids." + std::to_string( i )).c_str() ); ++i ) {
+                  auto it = h.byid.find( l.num_arg( ("holdids." + std::to_string( i )).c_str() ) );
+                  if( it != h.byid.end() ) h.erase( it );
+               }
+               return;
+            }
+            case nm( "crtstream" ): {
+               if( !l.asset_arg( "quantity", amount, sym ) ) break;
+               uint64_t payer = l.name_arg( "payer" );
+               ledger( l, payer, op_debit, amount, sym );
+               auto& streams = _streams[{ l.code, sym }];
+               uint64_t id = streams.empty() ? 0 : streams.rbegin()->first + 1;
+               streams[id] = stream_row{ payer, l.name_arg( "payee" ), amount, 0,
+                                         uint32_t( l.num_arg( "start" ) ), uint32_t( l.num_arg( "end" ) ) };
+               return;
+            }
+            case nm( "claimstream" ):
+            case nm( "cancelstream" ): {
+               sym = l.symbol_arg( "symbolo" );
+               auto& streams = _streams[{ l.code, sym }];
+               auto st = streams.find( l.num_arg( "id" ) );
+               if( st == streams.end() ) { fail( l, "stream doesn't exist" ); return; }
+               int64_t vested = st->second.vested( l.time );
+               int64_t owed = vested - st->second.withdrawn;
+               if( l.name == nm( "claimstream" ) ) {
+                  if( owed <= 0 ) { fail( l, "nothing to claim" ); return; }
+                  ledger( l, st->second.payee, op_credit, owed, sym );
+                  st->second.withdrawn += owed;
+                  if( st->second.withdrawn == st->second.deposit ) streams.erase( st );
+               } else {
+                  if( owed > 0 ) ledger( l, st->second.payee, op_credit, owed, sym );
+                  int64_t refund = st->second.deposit - vested;
+                  if( refund > 0 ) ledger( l, st->second.payer, op_credit, refund, sym );
+                  streams.erase( st );
+               }
+               return;
+            }
+         }
+      }
+      fail( l, "unsupported or malformed action " + name_string( l.name ) );
+   }
+
+   void replayer::dispatch_goods( const log_line& l ) {
+      goods_state& g = _goods[l.code];
+      auto ids = [&]() {
+         std::vector<uint64_t> out;
+         for( uint32_t i = 0; l.has( ("tokeninfo_ids." + std::to_string( i )).c_str() ); ++i ) {
+            out.push_back( l.num_arg( ("tokeninfo_ids." + std::to_string( i )).c_str() ) );
+         }
+         return out;
+      };
+      auto issue = [&]( uint64_t token_name, uint64_t serial, uint64_t to, const string& type, const string& uri,
+                        const string* metadata ) {
+         g.tokeninfo[serial] = goods_state::item{ to, token_name, type, uri, metadata ? *metadata : string(), metadata != nullptr };
+      };
+
+      switch( l.name ) {
+         case nm( "create" ): {
+            uint64_t token_name = l.name_arg( "token_name" );
+            if( g.tokenstats.count( token_name ) ) { fail( l, "nft already exists" ); return; }
+            g.tokenstats[token_name] = goods_state::stats{ l.name_arg( "issuer" ), l.arg( "fungible" ) == "true",
+                                                           l.arg( "burnable" ) == "true", l.arg( "transferable" ) == "true",
+                                                           l.num_arg( "max_supply" ), 0, 0 };
+            return;
+         }
+         case nm( "issue" ):
+         case nm( "issueitem" ): {
+            uint64_t token_name = l.name_arg( "token_name" );
+            auto st = g.tokenstats.find( token_name );
+            if( st == g.tokenstats.end() || st->second.current_supply >= st->second.max_supply ) {
+               fail( l, "issue beyond supply or of an unknown token" );
+               return;
+            }
+            st->second.current_supply += 1;
+            uint64_t serial = g.reserve_serials( 1 );
+            if( l.name == nm( "issue" ) ) issue( token_name, serial, l.name_arg( "to" ), l.arg( "metadata_type" ), l.arg( "metadata_uri" ), nullptr );
+            else                          issue( token_name, serial, l.name_arg( "to" ), "itemmeta", "", &l.arg( "metadata" ) );
+            return;
+         }
+         case nm( "burnnft" ):
+            for( uint64_t id : ids() ) {
+               if( !g.tokeninfo.erase( id ) ) fail( l, "burn of a missing item" );
+            }
+            return;
+         case nm( "transfernft" ): {
+            uint64_t to = l.name_arg( "to" );
+            for( uint64_t id : ids() ) {
+               auto it = g.tokeninfo.find( id );
+               if( it == g.tokeninfo.end() ) { fail( l, "transfer of a missing item" ); continue; }
+               it->second.owner = to;
+            }
+            return;
+         }
+         case nm( "list" ): {
+            int64_t price;
+            uint64_t sym;
+            if( !l.asset_arg( "price", price, sym ) ) break;
+            uint64_t seller = l.name_arg( "seller" ), contract = l.name_arg( "token_contract" );
+            for( uint64_t id : ids() ) {
+               auto it = g.tokeninfo.find( id );
+               if( it == g.tokeninfo.end() ) { fail( l, "listing of a missing item" ); continue; }
+               it->second.owner = l.code;
+               g.listings[id] = goods_state::listing{ seller, it->second.token_name, contract, price, sym };
+               g.byprice.emplace( it->second.token_name, contract, sym, uint64_t( price ), id );
+            }
+            return;
+         }
+         case nm( "delist" ): {
+            uint64_t seller = l.name_arg( "seller" );
+            for( uint64_t id : ids() ) {
+               auto lst = g.listings.find( id );
+               auto it = g.tokeninfo.find( id );
+               if( lst == g.listings.end() || it == g.tokeninfo.end() ) { fail( l, "delisting a missing listing" ); continue; }
+               it->second.owner = seller;
+               g.byprice.erase( std::make_tuple( lst->second.token_name, lst->second.token_contract, lst->second.price_sym,
+                                                 uint64_t( lst->second.price ), id ) );
+               g.listings.erase( lst );
+            }
+            return;
+         }
+         case nm( "onpayment" ): {
+            //a transfer to the market with memo "buy:<token_name>" fills the cheapest listing
+            //priced in that token, the payout and change are their own transfer lines
+            int64_t paid;
+            uint64_t sym;
+            uint64_t from = l.name_arg( "from" );
+            const string& memo = l.arg( "memo" );
+            if( from == l.code || l.name_arg( "to" ) != l.code || memo.compare( 0, 4, "buy:" ) != 0 ) return;
+            if( !l.asset_arg( "quantity", paid, sym ) ) break;
+            uint64_t token_name = name_value( memo.substr( 4 ) );
+            auto it = g.byprice.lower_bound( std::make_tuple( token_name, l.notifier, sym, uint64_t( 0 ), uint64_t( 0 ) ) );
+            if( it == g.byprice.end() || std::get<0>( *it ) != token_name || std::get<1>( *it ) != l.notifier || std::get<2>( *it ) != sym ) {
+               fail( l, "no listing for token in this currency" );
+               return;
+            }
+            uint64_t serial = std::get<4>( *it );
+            if( int64_t( std::get<3>( *it ) ) > paid || g.listings[serial].seller == from ) { fail( l, "purchase of a listing it cannot fill" ); return; }
+            g.tokeninfo[serial].owner = from;
+            g.listings.erase( serial );
+            g.byprice.erase( it );
+            return;
+         }
+         case nm( "createvouch" ): {
+            uint64_t token_name = l.name_arg( "token_name" );
+            uint32_t count = uint32_t( l.num_arg( "count" ) );
+            auto st = g.tokenstats.find( token_name );
+            if( st == g.tokenstats.end() || count > st->second.max_supply - st->second.current_supply ) {
+               fail( l, "voucher beyond supply or of an unknown token" );
+               return;
+            }
+            st->second.current_supply += count;
+            uint64_t first = g.reserve_serials( count );
+            g.vouchers[first] = goods_state::voucher{ token_name, count, 0, false, l.arg( "root" ),
+                                                      l.arg( "metadata_type" ), l.arg( "metadata_uri" ), {} };
+            return;
+         }
+         case nm( "claimvouch" ): {
+            auto v = g.vouchers.find( l.num_arg( "voucher_id" ) );
+            uint64_t index = l.num_arg( "index" );
+            if( v == g.vouchers.end() || v->second.closed || index >= v->second.count ) { fail( l, "claim of a missing voucher" ); return; }
+            v->second.words.insert( index >> 6 );
+            v->second.claimed += 1;
+            issue( v->second.token_name, v->first + index, l.name_arg( "to" ), v->second.metadata_type, v->second.metadata_uri, nullptr );
+            return;
+         }
+         case nm( "closevouch" ): {
+            auto v = g.vouchers.find( l.num_arg( "voucher_id" ) );
+            if( v == g.vouchers.end() ) { fail( l, "close of a missing voucher" ); return; }
+            if( !v->second.closed ) {
+               g.tokenstats[v->second.token_name].current_supply -= v->second.count - v->second.claimed;
+               v->second.closed = true;
+            }
+            auto& words = v->second.words;
+            for( uint32_t n = 0; n < voucher_close_batch && !words.empty(); ++n ) words.erase( words.begin() );
+            if( words.empty() ) g.vouchers.erase( v );
+            return;
+         }
+         case nm( "logsale" ):
+         case nm( "getowners" ):
+            return;
+      }
+      fail( l, "unsupported or malformed action " + name_string( l.name ) );
+   }
+
+   //each worker applies the effects on its own rows, in log order
+   void replayer::apply_batch() {
+      std::vector<std::thread> workers;
+      for( unsigned w = 0; w < _threads; ++w ) {
+         workers.emplace_back( [this, w]() {
+            for( const auto& e : _pending[w] ) {
+               if( const char* what = apply( _stores[w], e ) ) {
+                  static const char* tables[] = { "accounts", "stat", "ledger", "custody", "brandregs", "brands", "reputations", "cledgers" };
+                  _failures[w].push_back( failure{ e.line, name_string( e.key.code ) + " " + tables[e.key.table] + " " +
+                                                   name_string( e.key.scope ) + " " + name_string( e.key.pk ) + ": " + what } );
+               }
+            }
+            _pending[w].clear();
+         });
+      }
+      for( auto& t : workers ) t.join();
+   }
+
+   void replayer::replay( const string& path ) {
+      int fd = ::open( path.c_str(), O_RDONLY );
+      if( fd < 0 ) throw std::runtime_error( "cannot open " + path );
+      struct stat st;
+      if( ::fstat( fd, &st ) != 0 ) { ::close( fd ); throw std::runtime_error( "cannot stat " + path ); }
+      size_t size = size_t( st.st_size );
+      if( size == 0 ) { ::close( fd ); return; }
+      void* map = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      ::close( fd );
+      if( map == MAP_FAILED ) throw std::runtime_error( "cannot map " + path );
+      const char* data = static_cast<const char*>( map );
+      ::madvise( map, size, MADV_SEQUENTIAL );
+
+      static constexpr size_t batch_lines = 1 << 16;
+      std::vector<log_line> batch( batch_lines );
+      std::vector<std::pair<const char*, const char*>> spans;
+      _pending.assign( _threads, std::vector<effect>() );
+
+      const char* p = data;
+      const char* e = data + size;
+      while( p < e ) {
+         spans.clear();
+         while( p < e && spans.size() < batch_lines ) {
+            const char* nl = static_cast<const char*>( std::memchr( p, '\n', size_t( e - p ) ) );
+            const char* le = nl ? nl : e;
+            spans.emplace_back( p, le );
+            p = le + 1;
+         }
+
+         //parse in parallel
+         std::vector<std::thread> parsers;
+         size_t per = (spans.size() + _threads - 1) / _threads;
+         for( unsigned w = 0; w < _threads; ++w ) {
+            parsers.emplace_back( [&, w]() {
+               for( size_t i = w * per; i < std::min( spans.size(), (w + 1) * per ); ++i ) {
+                  parse( batch[i], spans[i].first, spans[i].second );
+                  batch[i].line = _lines + i + 1;
+               }
+            });
+         }
+         for( auto& t : parsers ) t.join();
+
+         //turn actions into effects in log order, then apply them by row owner
+         for( size_t i = 0; i < spans.size(); ++i ) {
+            if( batch[i].keep ) dispatch( batch[i] );
+         }
+         _lines += spans.size();
+         apply_batch();
+      }
+      ::munmap( map, size );
+   }
+
+   void replayer::write_snapshot( FILE* out )const {
+      //rows sorted by key, so a snapshot of the same log is byte identical
+      std::vector<std::pair<row_key, row>> rows;
+      for( const auto& s : _stores ) rows.insert( rows.end(), s.begin(), s.end() );
+      std::sort( rows.begin(), rows.end(), []( const auto& a, const auto& b ) { return a.first < b.first; } );
+
+      auto head = [&]( uint64_t code, const char* table, const string& scope, uint64_t pk ) {
+         std::fprintf( out, "{\"code\":\"%s\",\"table\":\"%s\",\"scope\":\"%s\",\"primary_key\":\"%llu\",\"value\":{",
+                       name_string( code ).c_str(), table, scope.c_str(), (unsigned long long)pk );
+      };
+      for( const auto& kv : rows ) {
+         const row_key& k = kv.first;
+         const row& r = kv.second;
+         bool tapx = _codes.at( k.code ) == c_tapx;
+         switch( k.table ) {
+            case t_accounts:
+               head( k.code, "accounts", name_string( k.scope ), k.pk );
+               std::fprintf( out, "\"balance\":\"%s\"}}\n", asset_string( r.a, r.sym ).c_str() );
+               break;
+            case t_stat:
+               head( k.code, "stat", name_string( k.scope ), k.pk );
+               std::fprintf( out, "\"supply\":\"%s\",\"max_supply\":\"%s\",\"issuer\":\"%s\"}}\n", asset_string( r.a, r.sym ).c_str(),
+                             asset_string( r.b, r.sym ).c_str(), name_string( r.c ).c_str() );
+               break;
+            case t_ledger:
+               head( k.code, tapx ? "tapledgers" : "btokenlgrs", name_string( k.scope ), k.pk );
+               std::fprintf( out, "\"%s\":\"%s\",\"amount\":%lld}}\n", tapx ? "ledger_id" : "lgid", name_string( k.pk ).c_str(), (long long)r.a );
+               break;
+            case t_custody:
+               head( k.code, "custody", name_string( k.scope ), k.pk );
+               std::fprintf( out, "\"stripe\":%llu,\"amount\":%lld}}\n", (unsigned long long)k.pk, (long long)r.a );
+               break;
+            case t_brandregs:
+               head( k.code, "brandregs", name_string( k.scope ), k.pk );
+               std::fprintf( out, "\"symbol\":\"%s\",\"contract\":\"%s\",\"staker\":\"%s\",\"staked\":\"%s\"}}\n",
+                             symbol_string( uint64_t( r.b ) ).c_str(), name_string( r.c ).c_str(), name_string( r.d ).c_str(),
+                             asset_string( r.a, r.sym ).c_str() );
+               break;
+            case t_brands:
+               head( k.code, "brands", name_string( k.scope ), k.pk );
+               std::fprintf( out, "\"symbol\":\"%s\",\"supply_auth\":\"%s\"}}\n", symbol_string( r.sym ).c_str(), name_string( r.c ).c_str() );
+               break;
+            case t_reputations:
+               head( k.code, "reputations", name_string( k.scope ), k.pk );
+               std::fprintf( out, "\"%s\":\"%s\",\"score\":%llu,\"updated\":%llu}}\n", tapx ? "ledger_id" : "lgid",
+                             name_string( k.pk ).c_str(), (unsigned long long)uint64_t( r.a ), (unsigned long long)r.c );
+               break;
+            case t_cledgers:
+               //one scope for all brands, the row names its symbol
+               head( k.code, "cledgers", name_string( k.code ), r.d );
+               std::fprintf( out, "\"id\":%llu,\"community\":%llu,\"user\":%llu,\"symbol\":\"%s\",\"amount\":%lld}}\n", (unsigned long long)r.d,
+                             (unsigned long long)k.pk, (unsigned long long)k.pk2, symbol_string( r.sym ).c_str(), (long long)r.a );
+               break;
+         }
+      }
+
+      for( const auto& s : _streams ) {
+         for( const auto& kv : s.second ) {
+            const stream_row& st = kv.second;
+            head( s.first.first, "streams", name_string( s.first.second >> 8 ), kv.first );
+            std::fprintf( out, "\"id\":%llu,\"payer\":\"%s\",\"payee\":\"%s\",\"deposit\":\"%s\",\"withdrawn\":\"%s\",\"start\":%u,\"end\":%u}}\n",
+                          (unsigned long long)kv.first, name_string( st.payer ).c_str(), name_string( st.payee ).c_str(),
+                          asset_string( st.deposit, s.first.second ).c_str(), asset_string( st.withdrawn, s.first.second ).c_str(), st.start, st.end );
+         }
+      }
+      for( const auto& h : _holds ) {
+         for( const auto& kv : h.second.byid ) {
+            head( h.first.first, "holds", name_string( h.first.second ), kv.first );
+            std::fprintf( out, "\"id\":%llu,\"lgid\":\"%s\",\"amount\":%lld,\"expires\":%u}}\n", (unsigned long long)kv.first,
+                          name_string( kv.second.lgid ).c_str(), (long long)kv.second.amount, kv.second.expires );
+         }
+      }
+      for( const auto& d : _dedup ) {
+         for( const auto& op : d.second.byexpires ) {
+            head( d.first, "ledgerops", name_string( d.first ), op.second );
+            std::fprintf( out, "\"id\":%llu,\"expires\":%u}}\n", (unsigned long long)op.second, op.first );
+         }
+      }
+
+      for( const auto& gk : _goods ) {
+         uint64_t code = gk.first;
+         const goods_state& g = gk.second;
+         string self = name_string( code );
+         for( const auto& kv : g.tokenstats ) {
+            const auto& s = kv.second;
+            head( code, "tokenstats", name_string( kv.first ), kv.first );
+            std::fprintf( out, "\"fungible\":%s,\"burnable\":%s,\"transferable\":%s,\"issuer\":\"%s\",\"token_name\":\"%s\","
+                               "\"max_supply\":{\"amount\":%llu,\"precision\":%u},\"current_supply\":%llu}}\n",
+                          s.fungible ? "true" : "false", s.burnable ? "true" : "false", s.transferable ? "true" : "false",
+                          name_string( s.issuer ).c_str(), name_string( kv.first ).c_str(), (unsigned long long)s.max_supply,
+                          unsigned( s.precision ), (unsigned long long)s.current_supply );
+         }
+         for( const auto& kv : g.tokeninfo ) {
+            const auto& it = kv.second;
+            head( code, "tokeninfo", self, kv.first );
+            std::fprintf( out, "\"serial_number\":%llu,\"owner\":\"%s\",\"token_name\":\"%s\",\"metadata_type\":%s,\"metadata_uri\":%s%s%s}}\n",
+                          (unsigned long long)kv.first, name_string( it.owner ).c_str(), name_string( it.token_name ).c_str(),
+                          quote( it.metadata_type ).c_str(), quote( it.metadata_uri ).c_str(),
+                          it.has_metadata ? ",\"metadata\":" : "", it.has_metadata ? quote( it.metadata ).c_str() : "" );
+         }
+         for( const auto& kv : g.listings ) {
+            const auto& lst = kv.second;
+            head( code, "listings", self, kv.first );
+            std::fprintf( out, "\"serial_number\":%llu,\"seller\":\"%s\",\"token_name\":\"%s\",\"token_contract\":\"%s\",\"price\":\"%s\"}}\n",
+                          (unsigned long long)kv.first, name_string( lst.seller ).c_str(), name_string( lst.token_name ).c_str(),
+                          name_string( lst.token_contract ).c_str(), asset_string( lst.price, lst.price_sym ).c_str() );
+         }
+         for( const auto& kv : g.vouchers ) {
+            const auto& v = kv.second;
+            head( code, "vouchers", self, kv.first );
+            std::fprintf( out, "\"first_serial\":%llu,\"token_name\":\"%s\",\"count\":%u,\"claimed\":%u,\"closed\":%s,\"root\":%s,"
+                               "\"metadata_type\":%s,\"metadata_uri\":%s}}\n",
+                          (unsigned long long)kv.first, name_string( v.token_name ).c_str(), v.count, v.claimed, v.closed ? "true" : "false",
+                          quote( v.root ).c_str(), quote( v.metadata_type ).c_str(), quote( v.metadata_uri ).c_str() );
+         }
+         if( g.serials_exist ) {
+            head( code, "serials", self, nm( "serials" ) );
+            std::fprintf( out, "\"next_serial\":%llu}}\n", (unsigned long long)g.next_serial );
+         }
+      }
+   }
+
+   /**
+   * Conservation per contract and symbol, from an empty start:
+   *   stat supply        = accounts balances + custody stripes
+   *   custody stripes    = ledgers + community ledgers + stream escrow
+   *
+   * @return number of violations, each printed
+   **/
+   uint64_t replayer::check_invariants()const {
+      struct sums { int128 supply = 0, holders = 0, stripes = 0, ledgers = 0; bool stat = false; };
+      std::map<std::pair<uint64_t, uint64_t>, sums> totals;
+      for( const auto& s : _stores ) {
+         for( const auto& kv : s ) {
+            const row& r = kv.second;
+            auto& t = totals[{ kv.first.code, r.sym }];
+            switch( kv.first.table ) {
+               case t_accounts:  t.holders += r.a; break;
+               case t_stat:      t.supply = r.a; t.stat = true; break;
+               case t_custody:   t.stripes += r.a; break;
+               case t_ledger:
+               case t_cledgers:  t.ledgers += r.a; break;
+               default:          break;
+            }
+         }
+      }
+      for( const auto& s : _streams ) {
+         for( const auto& kv : s.second ) totals[s.first].ledgers += kv.second.deposit - kv.second.withdrawn;
+      }
+
+      uint64_t errors = 0;
+      for( const auto& kv : totals ) {
+         const sums& t = kv.second;
+         if( !t.stat && t.holders == 0 && t.stripes == 0 && t.ledgers == 0 ) continue;
+         string what = name_string( kv.first.first ) + " " + symbol_string( kv.first.second );
+         if( t.supply != t.holders + t.stripes ) {
+            ++errors;
+            std::printf( "ERROR supply %s stat=%s holders+custody=%s\n", what.c_str(),
+                         asset_string( int64_t( t.supply ), kv.first.second ).c_str(),
+                         asset_string( int64_t( t.holders + t.stripes ), kv.first.second ).c_str() );
+         }
+         if( t.stripes != t.ledgers ) {
+            ++errors;
+            std::printf( "ERROR custody %s custody=%s ledgers=%s\n", what.c_str(),
+                         asset_string( int64_t( t.stripes ), kv.first.second ).c_str(),
+                         asset_string( int64_t( t.ledgers ), kv.first.second ).c_str() );
+         }
+      }
+      return errors;
+   }
+
+   /**
+   * Comparable facts of a table dump, keyed "code|table|scope|key". Ledger
+   * balances are merged across the hot, cold and legacy tables.
+   **/
+   typedef std::map<string, string> fact_map;
+
+   void collect_facts( const string& path, const std::set<string>& codes, unsigned threads, fact_map& facts ) {
+      std::vector<fact_map> parts( threads );
+      scan_dump( path, threads, [&]( unsigned w, const dump_row& r ) {
+         const string& code = r.code();
+         if( !codes.count( code ) ) return;
+         const string& table = r.table();
+         fact_map& f = parts[w];
+         string base = code + "|";
+         dump_asset a;
+         if( table == "accounts" ) {
+            if( parse_asset( r.get( "value.balance" ), a ) ) f[base + "accounts|" + r.scope() + "|" + a.symbol] = a.to_string();
+         } else if( table == "stat" ) {
+            dump_asset max;
+            if( parse_asset( r.get( "value.supply" ), a ) && parse_asset( r.get( "value.max_supply" ), max ) ) {
+               f[base + "stat|" + a.symbol] = a.to_string() + " " + max.to_string() + " " + r.get( "value.issuer" );
+            }
+         } else if( table == "tapledgers" || table == "btokenlgrs" ) {
+            const string* id = r.find( "value.ledger_id" );
+            if( !id ) id = r.find( "value.lgid" );
+            if( id ) f[base + "ledger|" + r.scope() + "|" + *id] = r.get( "value.amount" );
+         } else if( table == "tapcolds" || table == "btokencolds" ) {
+            for( uint32_t n = 0; ; ++n ) {
+               string i = std::to_string( n );
+               const string* id = r.find( ("value.ids." + i).c_str() );
+               if( !id ) break;
+               f[base + "ledger|" + r.scope() + "|" + name_string( std::strtoull( id->c_str(), nullptr, 10 ) )] =
+                  r.get( ("value.amounts." + i).c_str() );
+            }
+         } else if( table == "tapbalances" || table == "btokenbals" ) {
+            const string* id = r.find( "value.ledger_id" );
+            if( !id ) id = r.find( "value.lgid" );
+            if( id && parse_asset( r.get( "value.balance" ), a ) ) {
+               f[base + "ledger|" + name_string( symbol_raw( a ) ) + "|" + *id] = std::to_string( a.amount );
+            }
+         } else if( table == "custody" ) {
+            f[base + "custody|" + r.scope() + "|" + r.get( "value.stripe" )] = r.get( "value.amount" );
+         } else if( table == "cledgers" ) {
+            f[base + "cledgers|" + r.get( "value.symbol" ) + "|" + r.get( "value.community" ) + "|" + r.get( "value.user" )] = r.get( "value.amount" );
+         } else if( table == "tokeninfo" ) {
+            f[base + "tokeninfo|" + r.get( "value.serial_number" )] = r.get( "value.owner" );
+         }
+      });
+      for( auto& p : parts ) facts.insert( p.begin(), p.end() );
+   }
+
+   void usage() {
+      std::fprintf( stderr, "usage: replayer --tapx ACCOUNT [--brand ACCOUNT]... [--goods ACCOUNT] [--threads N] [--rate N]\n"
+                            "                [--out snapshot.jsonl] [--verify DUMP]... LOG...\n" );
+      std::exit( 2 );
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   string tapx_code, goods_code, out_path = "snapshot.jsonl";
+   std::set<string> brand_codes;
+   std::vector<string> logs, verify;
+   unsigned threads = std::thread::hardware_concurrency();
+   int64_t rate = 10;
+
+   for( int i = 1; i < argc; ++i ) {
+      string a = argv[i];
+      if( a == "--tapx" && i + 1 < argc )          tapx_code = argv[++i];
+      else if( a == "--brand" && i + 1 < argc )    brand_codes.insert( argv[++i] );
+      else if( a == "--goods" && i + 1 < argc )    goods_code = argv[++i];
+      else if( a == "--threads" && i + 1 < argc )  threads = unsigned( std::atoi( argv[++i] ) );
+      else if( a == "--rate" && i + 1 < argc )     rate = std::atoll( argv[++i] );
+      else if( a == "--out" && i + 1 < argc )      out_path = argv[++i];
+      else if( a == "--verify" && i + 1 < argc )   verify.push_back( argv[++i] );
+      else if( !a.empty() && a[0] == '-' )         usage();
+      else                                         logs.push_back( a );
+   }
+   if( tapx_code.empty() || logs.empty() || rate <= 0 ) usage();
+   if( threads == 0 ) threads = 1;
+
+   replayer r( threads, rate );
+   std::set<string> codes{ tapx_code };
+   r.add_code( name_value( tapx_code ), c_tapx );
+   for( const auto& b : brand_codes ) { r.add_code( name_value( b ), c_brand ); codes.insert( b ); }
+   if( !goods_code.empty() ) { r.add_code( name_value( goods_code ), c_goods ); codes.insert( goods_code ); }
+
+   auto started = std::chrono::steady_clock::now();
+   try {
+      for( const auto& log : logs ) r.replay( log );
+   } catch( const std::exception& e ) {
+      std::fprintf( stderr, "replayer: %s\n", e.what() );
+      return 1;
+   }
+   double secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - started ).count();
+
+   FILE* out = std::fopen( out_path.c_str(), "w" );
+   if( !out ) {
+      std::fprintf( stderr, "replayer: cannot write %s\n", out_path.c_str() );
+      return 1;
+   }
+   r.write_snapshot( out );
+   std::fclose( out );
+
+   uint64_t errors = 0;
+   auto failures = r.failures();
+   for( size_t i = 0; i < failures.size() && i < 20; ++i ) {
+      std::printf( "ERROR line %llu: %s\n", (unsigned long long)failures[i].line, failures[i].what.c_str() );
+   }
+   if( failures.size() > 20 ) std::printf( "ERROR ... %zu more failed actions\n", failures.size() - 20 );
+   errors += failures.size();
+   errors += r.check_invariants();
+
+   for( const auto& dump : verify ) {
+      fact_map mine, chain;
+      collect_facts( out_path, codes, threads, mine );
+      collect_facts( dump, codes, threads, chain );
+      uint64_t diffs = 0;
+      auto report = [&]( const string& key, const string* want, const string* got ) {
+         if( ++diffs <= 20 ) {
+            std::printf( "DIFF  %s chain=%s replay=%s\n", key.c_str(), want ? want->c_str() : "-", got ? got->c_str() : "-" );
+         }
+      };
+      for( const auto& kv : chain ) {
+         auto it = mine.find( kv.first );
+         if( it == mine.end() ) report( kv.first, &kv.second, nullptr );
+         else if( it->second != kv.second ) report( kv.first, &kv.second, &it->second );
+      }
+      for( const auto& kv : mine ) {
+         if( !chain.count( kv.first ) ) report( kv.first, nullptr, &kv.second );
+      }
+      std::printf( "verify %s: %zu rows compared, %llu differences\n", dump.c_str(), chain.size(), (unsigned long long)diffs );
+      errors += diffs;
+   }
+
+   std::printf( "replayed %llu actions from %llu lines in %.1fs with %u threads (%.0f actions/s), %llu errors, snapshot %s\n",
+                (unsigned long long)r.actions(), (unsigned long long)r.lines(), secs, threads,
+                secs > 0 ? double( r.actions() ) / secs : 0.0, (unsigned long long)errors, out_path.c_str() );
+   return errors ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/**
+ *  vouchertree.cpp
+ *  copyright TAPx.io
+ *
+ *  Build the Merkle tree of a tapxdgoods voucher drop: the root to pass to
+ *  createvouch and, per recipient, the index and proof claimvouch takes.
+ *
+ *  Input is one recipient account per line; the line number (from 0) is the
+ *  leaf index, so recipient index i receives serial first_serial + i. Leaves
+ *  and nodes are hashed as the contract does:
+ *
+ *    leaf  sha256(0x00 || uint32 index || uint64 account)   little-endian
+ *    node  sha256(0x01 || left || right)
+ *
+ *  and a level of odd length is padded with a zero hash.
+ *
+ *  Build:  g++ -O2 -std=c++17 vouchertree.cpp -o vouchertree
+ *  Usage:  vouchertree recipients.txt > proofs.jsonl
+ *          the root is printed on stderr and as the first line of the output
+ */
+#include "../../common/sha256.hpp"
+#include "../../common/tabledump.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+using namespace tapx;
+
+namespace {
+
+   digest256 hash_leaf( uint32_t index, uint64_t account ) {
+      uint8_t buf[13];
+      buf[0] = 0;
+      for( int i = 0; i < 4; ++i ) buf[1 + i] = uint8_t( index >> (8 * i) );
+      for( int i = 0; i < 8; ++i ) buf[5 + i] = uint8_t( account >> (8 * i) );
+      return sha256( buf, sizeof(buf) );
+   }
+
+   digest256 hash_node( const digest256& left, const digest256& right ) {
+      uint8_t buf[65];
+      buf[0] = 1;
+      memcpy( buf + 1, left.data(), 32 );
+      memcpy( buf + 33, right.data(), 32 );
+      return sha256( buf, sizeof(buf) );
+   }
+
+   string hex( const digest256& d ) {
+      static const char* digits = "0123456789abcdef";
+      string out;
+      for( uint8_t b : d ) { out += digits[b >> 4]; out += digits[b & 15]; }
+      return out;
+   }
+
+   //account names only use .12345a-z, at most 12 characters here
+   bool valid_name( const string& s ) {
+      if( s.empty() || s.size() > 12 ) return false;
+      for( char c : s ) {
+         if( !(c == '.' || (c >= '1' && c <= '5') || (c >= 'a' && c <= 'z')) ) return false;
+      }
+      return true;
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   if( argc != 2 ) {
+      fprintf( stderr, "usage: vouchertree recipients.txt > proofs.jsonl\n" );
+      return 2;
+   }
+   std::ifstream in( argv[1] );
+   if( !in ) {
+      fprintf( stderr, "vouchertree: cannot open %s\n", argv[1] );
+      return 1;
+   }
+
+   std::vector<string> recipients;
+   string line;
+   while( std::getline( in, line ) ) {
+      if( !line.empty() && line.back() == '\r' ) line.pop_back();
+      if( !valid_name( line ) ) {
+         fprintf( stderr, "vouchertree: line %zu: invalid account \"%s\"\n", recipients.size() + 1, line.c_str() );
+         return 1;
+      }
+      recipients.push_back( line );
+   }
+   //limits of createvouch
+   if( recipients.empty() || recipients.size() > (1u << 20) ) {
+      fprintf( stderr, "vouchertree: need 1 to %u recipients\n", 1u << 20 );
+      return 1;
+   }
+
+   //levels[0] are the leaves, the last level holds the root
+   std::vector<std::vector<digest256>> levels( 1 );
+   for( size_t i = 0; i < recipients.size(); ++i ) levels[0].push_back( hash_leaf( uint32_t( i ), name_value( recipients[i] ) ) );
+   while( levels.back().size() > 1 ) {
+      auto& below = levels.back();
+      if( below.size() % 2 ) below.push_back( digest256{} );
+      std::vector<digest256> up;
+      for( size_t i = 0; i < below.size(); i += 2 ) up.push_back( hash_node( below[i], below[i + 1] ) );
+      levels.push_back( std::move( up ) );
+   }
+
+   string root = hex( levels.back()[0] );
+   printf( "{\"root\":\"%s\",\"count\":%zu}\n", root.c_str(), recipients.size() );
+   for( size_t i = 0; i < recipients.size(); ++i ) {
+      printf( "{\"index\":%zu,\"to\":\"%s\",\"proof\":[", i, recipients[i].c_str() );
+      size_t idx = i;
+      for( size_t level = 0; level + 1 < levels.size(); ++level, idx >>= 1 ) {
+         printf( "%s\"%s\"", level ? "," : "", hex( levels[level][idx ^ 1] ).c_str() );
+      }
+      printf( "]}\n" );
+   }
+   fprintf( stderr, "root %s, %zu recipients, proof depth %zu\n", root.c_str(), recipients.size(), levels.size() - 1 );
+   return 0;
+}